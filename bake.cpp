@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "bake.hpp"
+#include "marching.hpp"
+
+static const char bake_magic[4] = { 'M', 'B', 'B', 'K' };
+static const std::uint32_t bake_version = 1;
+// pack_edge keeps 15 bits of a coordinate
+static const std::uint32_t bake_max_grid = 0x7FFF;
+
+static std::size_t align8(std::size_t offset) {
+    return (offset + 7) & ~std::size_t(7);
+}
+
+// count items of size bytes at offset lie inside the file, offset is a multiple of alignment;
+// no sum here can wrap around, whatever the file says
+static bool fits(std::uint64_t offset, std::uint64_t count, std::size_t size, std::size_t length,
+    std::size_t alignment) {
+    return offset <= length && offset % alignment == 0 && count <= (length - offset) / size;
+}
+
+// isolines of one frame in the packed format
+class bake_contour : public marching {
+private:
+    std::uint32_t emit(int x, int y, edge_kind kind, float t) override {
+        edges.push_back(pack_edge(x, y, kind));
+        parts.push_back(pack_part(t));
+        return edges.size() - 1;
+    }
+
+public:
+    std::vector<std::uint32_t> edges;
+    std::vector<std::uint16_t> parts;
+
+    const std::vector<std::uint32_t> &indexes() const {
+        return ind;
+    }
+
+    void clear() {
+        edges.clear();
+        parts.clear();
+        ind.clear();
+    }
+};
+
+template <typename T>
+static std::size_t write_array(std::ofstream &out, std::size_t offset, const std::vector<T> &data) {
+    static const char zeros[8] = {};
+    std::size_t aligned = align8(offset);
+    out.write(zeros, aligned - offset);
+    out.write(reinterpret_cast<const char *>(data.data()), data.size() * sizeof(T));
+    return aligned;
+}
+
+bake_stats write_bake(const std::filesystem::path &path, function &f, const bake_options &options) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    float from = options.from, to = options.to;
+    bool periodic = to <= from;
+    if (periodic) {
+        float period = f.period();
+        if (period == 0)
+            throw std::runtime_error("The scene doesn't repeat, give the time range to bake");
+        to = from + period;
+    }
+    if (!(options.fps > 0) || options.cell <= 0 || options.width <= 0 || options.height <= 0
+        || options.width / options.cell + 2 > int(bake_max_grid) || options.height / options.cell + 2 > int(bake_max_grid))
+        throw std::runtime_error("Bad bake options");
+
+    bake_header header;
+    std::memcpy(header.magic, bake_magic, 4);
+    header.version = bake_version;
+    header.width = options.width / options.cell + 2;
+    header.height = options.height / options.cell + 2;
+    header.cell = options.cell;
+    header.count_of_frames = std::max(1, int(std::ceil((to - from) * options.fps)));
+    header.count_of_levels = f.consts.size();
+    header.periodic = periodic;
+    header.from = from;
+    // whole number of frames per period, so the last frame comes right before the first one
+    header.step = (to - from) / header.count_of_frames;
+    header.left_bound = f.left_bound;
+    header.right_bound = f.right_bound;
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open())
+        throw std::runtime_error("Can't write bake: " + path.generic_string());
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(f.consts.data()), f.consts.size() * sizeof(float));
+    std::size_t table = align8(sizeof(header) + f.consts.size() * sizeof(float));
+    std::vector<bake_frame> frames(header.count_of_frames);
+    // the table is written again when it is filled
+    std::size_t offset = write_array(out, sizeof(header) + f.consts.size() * sizeof(float), frames)
+        + frames.size() * sizeof(bake_frame);
+
+    std::vector<float> values(std::size_t(header.width) * header.height);
+    std::vector<std::uint16_t> quantized(values.size());
+    bake_contour lines;
+    lines.set_grid(header.width - 1, header.height - 1);
+    float scale = 65535 / (header.right_bound - header.left_bound);
+    for (std::uint32_t i = 0; i < header.count_of_frames; ++i) {
+        float t = from + i * header.step;
+        f.update(t);
+        for (std::uint32_t y = 0; y < header.height; ++y)
+            for (std::uint32_t x = 0; x < header.width; ++x) {
+                float v = f.calc(float(x * header.cell), float(y * header.cell), t);
+                values[y * header.width + x] = v;
+                quantized[y * header.width + x] = std::uint16_t(
+                    std::min(std::max((v - header.left_bound) * scale, 0.f), 65535.f) + 0.5f);
+            }
+        // isolines come from the exact values, only colors are quantized
+        lines.clear();
+        lines.march(values, f.consts);
+
+        auto &frame = frames[i];
+        frame.count_of_vertices = lines.edges.size();
+        frame.count_of_indexes = lines.indexes().size();
+        frame.values = write_array(out, offset, quantized);
+        offset = frame.values + quantized.size() * sizeof(std::uint16_t);
+        frame.edges = write_array(out, offset, lines.edges);
+        offset = frame.edges + lines.edges.size() * sizeof(std::uint32_t);
+        frame.parts = write_array(out, offset, lines.parts);
+        offset = frame.parts + lines.parts.size() * sizeof(std::uint16_t);
+        frame.ind = write_array(out, offset, lines.indexes());
+        offset = frame.ind + lines.indexes().size() * sizeof(std::uint32_t);
+    }
+
+    out.seekp(table);
+    out.write(reinterpret_cast<const char *>(frames.data()), frames.size() * sizeof(bake_frame));
+    out.close();
+    if (!out)
+        throw std::runtime_error("Can't write bake: " + path.generic_string());
+
+    bake_stats stats;
+    stats.frames = header.count_of_frames;
+    stats.bytes = offset;
+    stats.seconds = std::chrono::duration_cast<std::chrono::duration<float>>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    return stats;
+}
+
+baked::baked(const std::filesystem::path &path) : file(path, "bake") {
+    const auto *bytes = file.bytes();
+    std::size_t length = file.size();
+    header = {};
+    if (length >= sizeof(header))
+        std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, bake_magic, 4) != 0 || header.version != bake_version)
+        throw std::runtime_error("Not a bake file: " + path.generic_string());
+
+    // the grid has to fit the packed vertices and positions in pixels
+    if (!(header.step > 0) || !std::isfinite(header.step) || !std::isfinite(header.from)
+        || !(header.left_bound < header.right_bound) || !std::isfinite(header.right_bound - header.left_bound)
+        || header.width < 2 || header.height < 2 || header.width > bake_max_grid || header.height > bake_max_grid
+        || header.cell == 0 || std::uint64_t(header.cell) * std::max(header.width, header.height) > INT32_MAX)
+        throw std::runtime_error("Bad bake header: " + path.generic_string());
+
+    if (header.count_of_frames == 0
+        || !fits(sizeof(header), header.count_of_levels, sizeof(float), length, 8))
+        throw std::runtime_error("Bake is truncated: " + path.generic_string());
+    std::size_t table = align8(sizeof(header) + std::size_t(header.count_of_levels) * sizeof(float));
+    if (!fits(table, header.count_of_frames, sizeof(bake_frame), length, 8))
+        throw std::runtime_error("Bake is truncated: " + path.generic_string());
+    levels = reinterpret_cast<const float *>(bytes + sizeof(header));
+    frames = reinterpret_cast<const bake_frame *>(bytes + table);
+
+    std::size_t count_of_values = std::size_t(header.width) * header.height;
+    for (std::uint32_t i = 0; i < header.count_of_frames; ++i) {
+        const auto &frame = frames[i];
+        if (!fits(frame.values, count_of_values, sizeof(std::uint16_t), length, 2)
+            || !fits(frame.edges, frame.count_of_vertices, sizeof(std::uint32_t), length, 8)
+            || !fits(frame.parts, frame.count_of_vertices, sizeof(std::uint16_t), length, 2)
+            || !fits(frame.ind, frame.count_of_indexes, sizeof(std::uint32_t), length, 8))
+            throw std::runtime_error("Bake is truncated: " + path.generic_string());
+        // indexes go to glDrawElements as they are
+        const std::uint32_t *ind = indexes(i);
+        for (std::uint32_t j = 0; j < frame.count_of_indexes; ++j)
+            if (ind[j] >= frame.count_of_vertices)
+                throw std::runtime_error("Bad isolines in bake: " + path.generic_string());
+    }
+}
+
+float baked::locate(float t, std::size_t &first, std::size_t &second) const {
+    float position = (t - header.from) / header.step;
+    // a tiny step can overflow it
+    if (!std::isfinite(position))
+        position = 0;
+    float count = header.count_of_frames;
+    if (header.periodic) {
+        position = std::fmod(position, count);
+        if (position < 0)
+            position += count;
+    }
+    else {
+        // there is nothing between the last frame and the first one, so play it back and forth
+        float lap = 2 * (count - 1);
+        position = lap > 0 ? std::fmod(std::fabs(position), lap) : 0;
+        if (position > count - 1)
+            position = lap - position;
+    }
+    first = std::min(std::size_t(position), std::size_t(count - 1));
+    second = header.periodic ? (first + 1) % header.count_of_frames
+        : std::min(first + 1, std::size_t(count - 1));
+    return position - first;
+}
+
+void baked::prefetch(std::size_t frame) const {
+    const auto &f = frames[frame];
+    file.prefetch(file.bytes() + f.values, f.ind + f.count_of_indexes * sizeof(std::uint32_t) - f.values);
+}
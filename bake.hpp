@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+
+#include "functions.hpp"
+#include "mapped_file.hpp"
+
+// Baked animation file:
+//   bake_header
+//   float       levels[count_of_levels]
+//   bake_frame  frames[count_of_frames]
+//   then every frame, each array starts on an 8-byte boundary:
+//     std::uint16_t values[width * height] - 0 is left_bound, 65535 is right_bound
+//     std::uint32_t edges[count_of_vertices] - isoline vertices, see pack_edge
+//     std::uint16_t parts[count_of_vertices]
+//     std::uint32_t ind[count_of_indexes]
+// Values are on the grid of canvas: vertex (i, j) is at (i * cell, j * cell) pixels.
+// Frame i is the moment from + i * step.
+
+struct bake_header {
+	char magic[4];
+	std::uint32_t version;
+	std::uint32_t width, height, cell;
+	std::uint32_t count_of_frames, count_of_levels;
+	// the frame after the last one is the first one again
+	std::uint32_t periodic;
+	float from, step;
+	float left_bound, right_bound;
+};
+
+// offsets from the beginning of the file
+struct bake_frame {
+	std::uint64_t values, edges, parts, ind;
+	std::uint32_t count_of_vertices, count_of_indexes;
+};
+
+struct bake_options {
+	int width = 1920,
+		height = 1080,
+		cell = 15;
+	// one period of the function if to <= from
+	float from = 0,
+		to = 0;
+	float fps = 30;
+};
+
+struct bake_stats {
+	std::size_t frames = 0,
+		bytes = 0;
+	float seconds = 0;
+};
+
+bake_stats write_bake(const std::filesystem::path &path, function &f, const bake_options &options);
+
+// read-only view of a mapped bake file
+class baked {
+private:
+	mapped_file file;
+
+public:
+	bake_header header;
+	const float *levels = nullptr;
+	const bake_frame *frames = nullptr;
+
+	explicit baked(const std::filesystem::path &path);
+
+	const std::uint16_t *values(std::size_t frame) const {
+		return reinterpret_cast<const std::uint16_t *>(file.bytes() + frames[frame].values);
+	}
+
+	const std::uint32_t *edges(std::size_t frame) const {
+		return reinterpret_cast<const std::uint32_t *>(file.bytes() + frames[frame].edges);
+	}
+
+	const std::uint16_t *parts(std::size_t frame) const {
+		return reinterpret_cast<const std::uint16_t *>(file.bytes() + frames[frame].parts);
+	}
+
+	const std::uint32_t *indexes(std::size_t frame) const {
+		return reinterpret_cast<const std::uint32_t *>(file.bytes() + frames[frame].ind);
+	}
+
+	// frames on both sides of the moment t and how far it is from the first one, 0 ... 1;
+	// playback goes round the baked time
+	float locate(float t, std::size_t &first, std::size_t &second) const;
+
+	// asks the system to read the frame ahead of time
+	void prefetch(std::size_t frame) const;
+};
@@ -0,0 +1,272 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "marching.hpp"
+
+// Isolines of a raw float32 raster of any size, without GL.
+//
+// contour_raster <in.raw> <width> <height> <levels> <out> [--geojson] [--read]
+//   levels     comma separated, e.g. 100,200,300
+//   --geojson  one GeoJSON LineString feature per line instead of the binary format
+//   --read     read rows with fread instead of mapping the file
+// contour_raster --generate <width> <height> <out.raw>
+//
+// Coordinates are in pixels: column, row.
+// Binary format: "ISOL", std::uint32_t count of levels, float levels[count],
+// then segments of { float x_1, y_1, x_2, y_2; std::uint32_t level; }.
+
+// rows of the raster, only the last two of them are guaranteed to stay valid
+class raster_rows {
+private:
+    std::size_t width, height;
+    bool mapped = false;
+    const float *data = nullptr;
+    std::size_t length = 0;
+    std::FILE *file = nullptr;
+    std::vector<float> rows[2];
+
+public:
+    raster_rows(const std::string &path, std::size_t width, std::size_t height, bool read) :
+        width(width), height(height) {
+        length = width * height * sizeof(float);
+#ifndef WIN32
+        if (!read) {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("Can't open raster: " + path);
+            struct stat st;
+            if (fstat(fd, &st) != 0 || std::size_t(st.st_size) < length) {
+                close(fd);
+                throw std::runtime_error("Raster is smaller than " + std::to_string(length) + " bytes");
+            }
+            void *ptr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (ptr == MAP_FAILED)
+                throw std::runtime_error("Can't map raster: " + path);
+            madvise(ptr, length, MADV_SEQUENTIAL);
+            data = static_cast<const float *>(ptr);
+            mapped = true;
+            return;
+        }
+#endif
+        file = std::fopen(path.c_str(), "rb");
+        if (!file)
+            throw std::runtime_error("Can't open raster: " + path);
+        rows[0].resize(width);
+        rows[1].resize(width);
+    }
+
+    ~raster_rows() {
+#ifndef WIN32
+        if (mapped)
+            munmap(const_cast<float *>(data), length);
+#endif
+        if (file)
+            std::fclose(file);
+    }
+
+    raster_rows(const raster_rows &) = delete;
+    raster_rows &operator=(const raster_rows &) = delete;
+
+    // rows have to be asked one after another
+    const float *row(std::size_t y) {
+        if (mapped) {
+#ifndef WIN32
+            // give back the pages of rows that are done, so the resident set stays small
+            const std::size_t band = 256;
+            if (y >= 2 * band && y % band == 0) {
+                const long page = sysconf(_SC_PAGESIZE);
+                auto from = reinterpret_cast<std::uintptr_t>(data + (y - 2 * band) * width);
+                auto to = reinterpret_cast<std::uintptr_t>(data + (y - band) * width);
+                from = from / page * page;
+                to = to / page * page;
+                if (to > from)
+                    madvise(reinterpret_cast<void *>(from), to - from, MADV_DONTNEED);
+            }
+#endif
+            return data + y * width;
+        }
+        auto &buffer = rows[y % 2];
+        if (std::fread(buffer.data(), sizeof(float), width, file) != width)
+            throw std::runtime_error("Raster is shorter than " + std::to_string(height) + " rows");
+        return buffer.data();
+    }
+};
+
+// writes segments as soon as a row is done, keeps only the vertices of the last row
+class contour_stream : public marching {
+private:
+    std::vector<vec2> points;
+    std::vector<vec2> kept;
+    std::vector<std::uint32_t> renumber;
+    std::ostream &out;
+    const std::vector<float> &consts;
+    bool geojson;
+
+    std::uint32_t emit(int x, int y, edge_kind kind, float t) override {
+        points.push_back(edge_point(x, y, kind, t));
+        return points.size() - 1;
+    }
+
+    void write(const vec2 &a, const vec2 &b, std::uint32_t level) {
+        if (geojson) {
+            out << "{\"type\":\"Feature\",\"properties\":{\"level\":" << consts[level]
+                << "},\"geometry\":{\"type\":\"LineString\",\"coordinates\":[["
+                << a.x << ',' << a.y << "],[" << b.x << ',' << b.y << "]]}}\n";
+            return;
+        }
+        float segment[4] = { a.x, a.y, b.x, b.y };
+        out.write(reinterpret_cast<const char *>(segment), sizeof(segment));
+        out.write(reinterpret_cast<const char *>(&level), sizeof(level));
+    }
+
+    // vertices that are not on the lower edges of the row are never used again
+    void compact() {
+        kept.clear();
+        renumber.assign(points.size(), UINT32_MAX);
+        for (auto &id : links()) {
+            if (id >= points.size()) {
+                id = 0;
+                continue;
+            }
+            if (renumber[id] == UINT32_MAX) {
+                renumber[id] = kept.size();
+                kept.push_back(points[id]);
+            }
+            id = renumber[id];
+        }
+        points.swap(kept);
+    }
+
+public:
+    std::size_t segments = 0;
+
+    contour_stream(std::ostream &out, const std::vector<float> &consts, bool geojson) :
+        out(out), consts(consts), geojson(geojson) {
+        // coordinates of large rasters need more than 6 digits
+        out << std::setprecision(std::numeric_limits<float>::max_digits10);
+        if (!geojson) {
+            std::uint32_t count = consts.size();
+            out.write("ISOL", 4);
+            out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+            out.write(reinterpret_cast<const char *>(consts.data()), count * sizeof(float));
+        }
+    }
+
+    void add_row(const float *upper, const float *lower, int y) {
+        march_row(upper, lower, y, consts);
+        for (std::size_t level = 0; level < consts.size(); ++level)
+            for (std::size_t i = starts[level]; i < starts[level + 1]; i += 2)
+                write(points[ind[i]], points[ind[i + 1]], level);
+        segments += ind.size() / 2;
+        ind.clear();
+        compact();
+    }
+};
+
+static std::vector<float> parse_levels(const std::string &list) {
+    std::vector<float> result;
+    std::istringstream ss(list);
+    for (std::string item; std::getline(ss, item, ',');)
+        result.push_back(std::stof(item));
+    if (result.empty())
+        throw std::runtime_error("No levels given");
+    return result;
+}
+
+static void generate(std::size_t width, std::size_t height, const std::string &path) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open())
+        throw std::runtime_error("Can't write " + path);
+    std::vector<float> row(width);
+    for (std::size_t y = 0; y < height; ++y) {
+        for (std::size_t x = 0; x < width; ++x)
+            row[x] = 1000 * std::sin(x * 0.0031f) * std::cos(y * 0.0027f) + 300 * std::sin((x + y) * 0.017f);
+        out.write(reinterpret_cast<const char *>(row.data()), width * sizeof(float));
+    }
+}
+
+static double peak_rss_mb() {
+#ifndef WIN32
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+#else
+    return 0;
+#endif
+}
+
+int main(int argc, char **argv) try
+{
+    if (argc == 5 && std::string(argv[1]) == "--generate") {
+        generate(std::stoul(argv[2]), std::stoul(argv[3]), argv[4]);
+        return 0;
+    }
+    if (argc < 6) {
+        std::cerr << "usage: " << argv[0] << " <in.raw> <width> <height> <levels> <out> [--geojson] [--read]\n"
+            << "       " << argv[0] << " --generate <width> <height> <out.raw>\n";
+        return EXIT_FAILURE;
+    }
+
+    std::size_t width = std::stoul(argv[2]), height = std::stoul(argv[3]);
+    if (width < 2 || height < 2)
+        throw std::runtime_error("Raster has to be at least 2x2");
+    std::vector<float> consts = parse_levels(argv[4]);
+    bool geojson = false, read = false;
+    for (int i = 6; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--geojson")
+            geojson = true;
+        else if (arg == "--read")
+            read = true;
+        else
+            throw std::runtime_error("Unknown argument: " + arg);
+    }
+
+    std::ofstream out(argv[5], geojson ? std::ios::out : std::ios::binary);
+    if (!out.is_open())
+        throw std::runtime_error("Can't write " + std::string(argv[5]));
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    raster_rows raster(argv[1], width, height, read);
+    contour_stream stream(out, consts, geojson);
+    stream.set_grid(width - 1, height - 1);
+    const float *upper = raster.row(0);
+    for (std::size_t y = 0; y + 1 < height; ++y) {
+        const float *lower = raster.row(y + 1);
+        stream.add_row(upper, lower, y);
+        upper = lower;
+    }
+    out.flush();
+
+    double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    double gigabytes = double(width) * height * sizeof(float) / 1e9;
+    std::cerr << width << "x" << height << ": " << stream.segments << " segments in " << seconds << " s, "
+        << gigabytes / seconds << " GB/s, peak RSS " << peak_rss_mb() << " MB" << std::endl;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
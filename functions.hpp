@@ -1,7 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <vector>
 
 const float PI = std::acos(-1.0);
 
@@ -50,6 +54,20 @@ public:
 
 	std::vector<float> consts;
 
+	// changes whenever consts or the shape of the function change
+	std::uint64_t revision = 0;
+
+	// calc doesn't depend on t
+	virtual bool time_invariant() const { return false; }
+
+	// the function repeats itself after this time, 0 if it doesn't or it's unknown
+	virtual float period() const { return 0; }
+
+	// how much calc can differ inside the rectangle between the last two update(t)
+	virtual float change_bound(float left, float top, float right, float bottom) const {
+		return time_invariant() ? 0 : std::numeric_limits<float>::infinity();
+	}
+
 	virtual float calc(float x, float y, float t) { return 0; }
 
 	virtual void update(float t) {}
@@ -70,6 +88,8 @@ public:
 		consts.insert(consts.end(), { -0.9, -0.75, -0.5, -0.25, -0.1, 0.1, 0.25, 0.5, 0.75, 0.9 });
 	}
 
+	bool time_invariant() const override { return true; }
+
 	float calc(float x, float y, float t) override {
 		return std::sin(std::hypot(x - cx, cy - y) * PI / 600);
 	}
@@ -109,8 +129,39 @@ public:
 	virtual ~traectory() = default;
 
 	virtual void update(float t) {}
+
+	// 0 for the ones that stand still
+	virtual float period() const { return 0; }
+
+	// every traectory below goes round once while v * t grows by 2 PI
+	static float period_of(float v) {
+		return v == 0 ? 0 : 2 * PI / std::fabs(v);
+	}
 };
 
+// shortest time after which all the periods repeat, 0 if it's longer than limit;
+// zero periods stand still and don't count
+inline float common_period(const std::vector<float> &periods, float limit = 3600) {
+	float longest = 0;
+	for (auto p : periods)
+		longest = std::max(longest, p);
+	if (longest == 0)
+		return 0;
+	for (int m = 1; m * longest <= limit; ++m) {
+		float candidate = m * longest;
+		bool fits = true;
+		for (auto p : periods) {
+			if (p == 0)
+				continue;
+			float turns = candidate / p;
+			fits = fits && std::fabs(turns - std::round(turns)) < 1e-4f;
+		}
+		if (fits)
+			return candidate;
+	}
+	return 0;
+}
+
 class circle : public traectory {
 private:
 	float R, phi, v;
@@ -120,9 +171,18 @@ public:
 	circle(float radius, int center_x, int center_y, float start_angle, int direction, float speed) :
 		R(radius), cx(center_x), cy(center_y), phi(start_angle), dir(direction), v(speed) {}
 
+	static vec2 at(float t, float R, float cx, float cy, float phi, float dir, float v) {
+		return vec2(cx + R * std::cos(dir * (v * t + phi)), cy - R * std::sin(dir * (v * t + phi)));
+	}
+
 	void update(float t) override {
-		traectory::x = cx + R * std::cos(dir * (v * t + phi));
-		traectory::y = cy - R * std::sin(dir * (v * t + phi));
+		vec2 res = at(t, R, cx, cy, phi, dir, v);
+		traectory::x = res.x;
+		traectory::y = res.y;
+	}
+
+	float period() const override {
+		return period_of(v);
 	}
 };
 
@@ -134,11 +194,19 @@ public:
 	segment(int x_1, int y_1, int x_2, int y_2, float start_angle, float speed) :
 		lx(x_1), ly(y_1), rx(x_2), ry(y_2), phi(start_angle), v(speed) {}
 
+	static vec2 at(float t, float lx, float ly, float rx, float ry, float phi, float v) {
+		return vec2(lx, ly).interpolate(vec2(rx, ry), (1 + std::sin(v * t + phi)) / 2);
+	}
+
 	void update(float t) override {
-		vec2 res = vec2(lx, ly).interpolate(vec2(rx, ry), (1 + std::sin(v * t + phi)) / 2);
+		vec2 res = at(t, lx, ly, rx, ry, phi, v);
 		traectory::x = res.x;
 		traectory::y = res.y;
 	}
+
+	float period() const override {
+		return period_of(v);
+	}
 };
 
 class parabola : public traectory {
@@ -149,9 +217,19 @@ public:
 	parabola(int center_x, int center_y, int width, int height, float start_angle, float speed) :
 		cx(center_x), cy(center_y), w(width), h(height), phi(start_angle), v(speed) {}
 
+	static vec2 at(float t, float cx, float cy, float w, float h, float phi, float v) {
+		return vec2(cx + int(w / 2) * std::sin(v * t + phi),
+			cy + h * (1 - std::cos(2 * (v * t + phi))) / 2);
+	}
+
 	void update(float t) override {
-		traectory::x = cx + (w / 2) * std::sin(v * t + phi);
-		traectory::y = cy + h * (1 - std::cos(2 * (v * t + phi))) / 2;
+		vec2 res = at(t, cx, cy, w, h, phi, v);
+		traectory::x = res.x;
+		traectory::y = res.y;
+	}
+
+	float period() const override {
+		return period_of(v);
 	}
 };
 
@@ -164,10 +242,10 @@ public:
 		pos(ptr), R2(radius * radius), w(weight), c(charge) {}
 };
 
-class metaballs : public function {
+// common part of every metaball system: bounds and levels
+class metaball_field : public function {
 private:
 	int count_of_consts = 5;
-	std::vector<metaball> balls;
 
 	void build_consts() {
 		consts.clear();
@@ -178,23 +256,63 @@ private:
 		for (float a = step; a < right_bound + step / 2; a += step)
 			consts.push_back(a);
 	}
+
+protected:
+	// How much a ball that moved from a to b changes the field inside the rectangle: not more
+	// than it gives at the nearest point, and not more than the way times the steepest slope.
+	// The slope of w exp(-r^2 / R^2) is w 2r / R^2 exp(-r^2 / R^2), the largest at r^2 = R^2 / 2,
+	// where it is w sqrt(2 / e) / R, and it only falls further away.
+	static float moved_bound(const vec2 &a, const vec2 &b, float R2, float w,
+		float left, float top, float right, float bottom) {
+		if (a.x == b.x && a.y == b.y)
+			return 0;
+		// the way lies in the box around a and b
+		float dx = std::max({ 0.f, std::min(a.x, b.x) - right, left - std::max(a.x, b.x) }),
+			dy = std::max({ 0.f, std::min(a.y, b.y) - bottom, top - std::max(a.y, b.y) }),
+			d2 = dx * dx + dy * dy;
+		vec2 way = b - a;
+		float nearest = std::exp(-d2 / R2),
+			slope = d2 > R2 / 2 ? 2 * std::sqrt(d2) / R2 * nearest : std::sqrt(2 / (std::exp(1.f) * R2));
+		return w * std::min(std::sqrt(way.x * way.x + way.y * way.y) * slope, nearest);
+	}
+
+	void add_to_bounds(float weight, int charge) {
+		if (charge < 0)
+			left_bound -= weight;
+		else
+			right_bound += weight;
+	}
+
+	void finish_bounds() {
+		build_consts();
+	}
+
 public:
-	metaballs(const std::vector<metaball> &system) : balls(system) {
-		float min = 0, max = 0;
-		for (auto ball : balls) {
-			if (ball.c < 0)
-				min -= ball.w;
-			else
-				max += ball.w;
+	void update(int dir) override {
+		if (count_of_consts + dir > 0) {
+			count_of_consts += dir;
+			build_consts();
+			++revision;
 		}
-		left_bound = min;
-		right_bound = max;
-		build_consts();
+	}
+};
+
+class metaballs : public metaball_field {
+private:
+	std::vector<metaball> balls;
+	// positions before the last update
+	std::vector<vec2> previous;
+	int updates = 0;
+public:
+	metaballs(const std::vector<metaball> &system) : balls(system) {
+		for (auto &ball : balls)
+			add_to_bounds(ball.w, ball.c);
+		finish_bounds();
 	}
 
 	float calc(float x, float y, float t) override {
 		float res = 0;
-		for (auto ball : balls) {
+		for (auto &ball : balls) {
 			float dx = x - ball.pos->x, dy = y - ball.pos->y;
 			res += ball.c * ball.w * std::exp(- (dx * dx + dy * dy) / ball.R2);
 		}
@@ -202,14 +320,26 @@ public:
 	}
 
 	void update(float t) override {
-		for (auto ball : balls)
-			ball.pos->update(t);
+		previous.resize(balls.size());
+		updates = std::min(updates + 1, 2);
+		for (std::size_t i = 0; i < balls.size(); ++i) {
+			previous[i] = vec2(balls[i].pos->x, balls[i].pos->y);
+			balls[i].pos->update(t);
+		}
 	}
 
-	void update(int dir) override {
-		if (count_of_consts + dir > 0) {
-			count_of_consts += dir;
-			build_consts();
-		}
+	float change_bound(float left, float top, float right, float bottom) const override {
+		float res = 0;
+		for (std::size_t i = 0; i < previous.size(); ++i)
+			res += moved_bound(previous[i], vec2(balls[i].pos->x, balls[i].pos->y), balls[i].R2, balls[i].w,
+				left, top, right, bottom);
+		return updates < 2 ? std::numeric_limits<float>::infinity() : res;
+	}
+
+	float period() const override {
+		std::vector<float> periods;
+		for (auto &ball : balls)
+			periods.push_back(ball.pos->period());
+		return common_period(periods);
 	}
 };
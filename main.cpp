@@ -11,9 +11,12 @@
 #include <stdexcept>
 #include <iostream>
 #include <chrono>
+#include <cctype>
+#include <cstdio>
 #include <vector>
 
 #include "series_n_units.hpp"
+#include "scene.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -31,8 +34,158 @@ void glew_fail(std::string_view message, GLenum error)
         reinterpret_cast<const char *>(glewGetErrorString(error)));
 }
 
-int main() try
+std::shared_ptr<function> default_scene()
 {
+    return std::shared_ptr<function>(new metaballs({
+        // metaball(std::shared_ptr<traectory>(new circle(20, 100, 20, 0, 1, 1)), 100, 2, 1) // debug ball
+        metaball(std::shared_ptr<traectory>(new circle(50, 600, 500, 0, 1, 2)), 70, 2, 1),
+        metaball(std::shared_ptr<traectory>(new circle(125, 700, 600, PI / 2, -1, 1.5)), 95, 0.5, -1),
+        metaball(std::shared_ptr<traectory>(new circle(130, 800, 300, 5 * PI / 6, 1, 0.6)), 120, 4, 1),
+        metaball(std::shared_ptr<traectory>(new circle(100, 1000, 300, 0, 1, 3)), 100, 3, 1),
+        metaball(std::shared_ptr<traectory>(new parabola(1000, 400, 400, 400, PI / 6, 1.5)), 40, 2, 1),
+        metaball(std::shared_ptr<traectory>(new circle(60, 1200, 500, 0, -1, 0.5)), 500, 5, 1),
+        metaball(std::shared_ptr<traectory>(new segment(100, 100, 1700, 900, PI / 2, 2.5)), 150, 2, -1),
+        metaball(std::shared_ptr<traectory>(new parabola(1300, 800, 700, -700, PI / 3, 0.75)), 140, 2, -1),
+        metaball(std::shared_ptr<traectory>(new circle(300, 550, 700, 0, -1, 1.5)), 200, 2.5, 1),
+        metaball(std::shared_ptr<traectory>(new segment(100, 600, 1700, 300, PI, 2.2)), 300, 2, 1),
+        metaball(std::shared_ptr<traectory>(new segment(1200, 200, 1200, 700, 0, 1.2)), 150, 3, -1),
+    }));
+}
+
+// balls of the default scene, the side view moves them in depth
+std::shared_ptr<metaballs3d> default_volume()
+{
+    return std::shared_ptr<metaballs3d>(new metaballs3d({
+        metaball3d(std::shared_ptr<traectory>(new circle(50, 600, 500, 0, 1, 2)),
+            std::shared_ptr<traectory>(new segment(0, -200, 0, 200, 0, 1.1)), 70, 2, 1),
+        metaball3d(std::shared_ptr<traectory>(new circle(125, 700, 600, PI / 2, -1, 1.5)),
+            std::shared_ptr<traectory>(new circle(150, 0, 0, 0, 1, 0.7)), 95, 0.5, -1),
+        metaball3d(std::shared_ptr<traectory>(new circle(130, 800, 300, 5 * PI / 6, 1, 0.6)),
+            std::shared_ptr<traectory>(new segment(0, 100, 0, -250, PI / 3, 0.9)), 120, 4, 1),
+        metaball3d(std::shared_ptr<traectory>(new circle(100, 1000, 300, 0, 1, 3)),
+            std::shared_ptr<traectory>(new circle(100, 0, 0, PI, -1, 1.3)), 100, 3, 1),
+        metaball3d(std::shared_ptr<traectory>(new parabola(1000, 400, 400, 400, PI / 6, 1.5)),
+            std::shared_ptr<traectory>(new segment(0, -300, 0, 300, 0, 0.5)), 40, 2, 1),
+        metaball3d(std::shared_ptr<traectory>(new circle(300, 550, 700, 0, -1, 1.5)),
+            std::shared_ptr<traectory>(new segment(0, 150, 0, -150, PI / 2, 0.8)), 200, 2.5, 1),
+        metaball3d(std::shared_ptr<traectory>(new segment(100, 600, 1700, 300, PI, 2.2)),
+            std::shared_ptr<traectory>(new circle(200, 0, 0, 0, 1, 0.4)), 300, 2, 1),
+        metaball3d(std::shared_ptr<traectory>(new segment(1200, 200, 1200, 700, 0, 1.2)),
+            std::shared_ptr<traectory>(new segment(0, -100, 0, 100, 0, 1.7)), 150, 3, -1),
+    }));
+}
+
+std::shared_ptr<function> load_scene(const std::string &path)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    auto system = std::make_shared<scene>(path);
+    std::shared_ptr<function> result(new scene_metaballs(system));
+    auto load_time = std::chrono::duration_cast<std::chrono::duration<float, std::milli>>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    std::cerr << "scene: " << system->count << " balls loaded in " << load_time << " ms" << std::endl;
+    return result;
+}
+
+// every fourth panel shows another function, the rest show the scene at different moments
+std::vector<panel> make_panels(int count, std::shared_ptr<function> field, int width, int height)
+{
+    std::vector<panel> result(count);
+    for (int i = 0; i < count; ++i)
+    {
+        if (i % 4 != 3)
+            result[i].f = field;
+        else if (i % 8 == 3)
+            result[i].f = std::make_shared<samsara>(width / 2, height / 2);
+        else
+            result[i].f = std::make_shared<bulk>(width / 2, height / 2);
+        result[i].time_offset = 0.5f * i;
+    }
+    return result;
+}
+
+// usage: isolines [--scene <scene.bin>] [--packed] [--panels <count>] [--tiles [<cache MB>]] [--volume] [--stats]
+//        isolines [--scene <scene.bin>] --bake <out.bake> [--range <from>:<to>] [--fps <n>] [--size <w>x<h>]
+//        isolines --play <in.bake> [--stats]
+//   --packed  edge-encoded isoline vertices
+//   --panels  dashboard of many fields instead of one canvas
+//   --tiles   pan and zoom over a tiled canvas, 64 MB of tiles by default
+//   --volume  isosurfaces of 3D metaballs, middle drag turns them
+//   --stats   print frame rate and uploaded bytes per frame every second
+//   --bake    write values and isolines of one period of the scene (or of the range) and exit
+//   --play    play a baked animation back without evaluating anything
+int main(int argc, char **argv) try
+{
+    auto startup = std::chrono::high_resolution_clock::now();
+    bool first_frame = true;
+
+    std::string scene_path;
+    bool packed = false, stats = false, volume = false;
+    int panels = 0;
+    std::size_t tiles_mb = 0;
+    std::string bake_path, play_path;
+    bake_options bake;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--scene" && i + 1 < argc)
+            scene_path = argv[++i];
+        else if (arg == "--packed")
+            packed = true;
+        else if (arg == "--panels" && i + 1 < argc)
+            panels = std::stoi(argv[++i]);
+        else if (arg == "--tiles")
+            tiles_mb = i + 1 < argc && std::isdigit(argv[i + 1][0]) ? std::stoul(argv[++i]) : 64;
+        else if (arg == "--volume")
+            volume = true;
+        else if (arg == "--bake" && i + 1 < argc)
+            bake_path = argv[++i];
+        else if (arg == "--range" && i + 1 < argc)
+        {
+            std::string value = argv[++i];
+            char rest;
+            if (std::sscanf(value.c_str(), "%f:%f%c", &bake.from, &bake.to, &rest) != 2 || !(bake.from < bake.to))
+                throw std::runtime_error("Bad --range value, expected <from>:<to> with from < to: " + value);
+        }
+        else if (arg == "--fps" && i + 1 < argc)
+        {
+            std::string value = argv[++i];
+            char rest;
+            if (std::sscanf(value.c_str(), "%f%c", &bake.fps, &rest) != 1 || !(bake.fps > 0))
+                throw std::runtime_error("Bad --fps value, expected a positive number: " + value);
+        }
+        else if (arg == "--size" && i + 1 < argc)
+        {
+            std::string value = argv[++i];
+            char rest;
+            if (std::sscanf(value.c_str(), "%dx%d%c", &bake.width, &bake.height, &rest) != 2
+                || bake.width <= 0 || bake.height <= 0)
+                throw std::runtime_error("Bad --size value, expected <width>x<height>: " + value);
+        }
+        else if (arg == "--play" && i + 1 < argc)
+            play_path = argv[++i];
+        else if (arg == "--stats")
+            stats = true;
+        else
+            throw std::runtime_error("Unknown argument: " + arg);
+    }
+
+    // scene files hold 2D balls only
+    if (volume && !scene_path.empty())
+        throw std::runtime_error("--volume doesn't work with --scene, it has its own 3D balls");
+    // tiles keep their isolines in cells, which the packed format can't hold
+    if (packed && tiles_mb > 0)
+        throw std::runtime_error("--packed doesn't work with --tiles");
+
+    std::shared_ptr<function> field = scene_path.empty() ? default_scene() : load_scene(scene_path);
+
+    if (!bake_path.empty())
+    {
+        auto result = write_bake(bake_path, *field, bake);
+        std::cerr << "baked " << result.frames << " frames, " << result.bytes / 1e6 << " MB in "
+            << result.seconds << " s" << std::endl;
+        return 0;
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
         sdl2_fail("SDL_Init: ");
 
@@ -74,20 +227,20 @@ int main() try
     float time = 0.f;
 
     bool running = true;
-    series *obj = new canvas(std::shared_ptr<function>(new metaballs({
-        // metaball(std::shared_ptr<traectory>(new circle(20, 100, 20, 0, 1, 1)), 100, 2, 1) // debug ball
-        metaball(std::shared_ptr<traectory>(new circle(50, 600, 500, 0, 1, 2)), 70, 2, 1),
-        metaball(std::shared_ptr<traectory>(new circle(125, 700, 600, PI / 2, -1, 1.5)), 95, 0.5, -1),
-        metaball(std::shared_ptr<traectory>(new circle(130, 800, 300, 5 * PI / 6, 1, 0.6)), 120, 4, 1),
-        metaball(std::shared_ptr<traectory>(new circle(100, 1000, 300, 0, 1, 3)), 100, 3, 1),
-        metaball(std::shared_ptr<traectory>(new parabola(1000, 400, 400, 400, PI / 6, 1.5)), 40, 2, 1),
-        metaball(std::shared_ptr<traectory>(new circle(60, 1200, 500, 0, -1, 0.5)), 500, 5, 1),
-        metaball(std::shared_ptr<traectory>(new segment(100, 100, 1700, 900, PI / 2, 2.5)), 150, 2, -1),
-        metaball(std::shared_ptr<traectory>(new parabola(1300, 800, 700, -700, PI / 3, 0.75)), 140, 2, -1),
-        metaball(std::shared_ptr<traectory>(new circle(300, 550, 700, 0, -1, 1.5)), 200, 2.5, 1),
-        metaball(std::shared_ptr<traectory>(new segment(100, 600, 1700, 300, PI, 2.2)), 300, 2, 1),
-        metaball(std::shared_ptr<traectory>(new segment(1200, 200, 1200, 700, 0, 1.2)), 150, 3, -1),
-    })));
+    series *obj;
+    if (!play_path.empty())
+        obj = new baked_canvas(std::make_shared<baked>(play_path));
+    else if (volume)
+        obj = new volume_view(default_volume());
+    else if (panels > 0)
+        obj = new dashboard(make_panels(panels, field, width, height), packed);
+    else if (tiles_mb > 0)
+        obj = new tiled_canvas(field, tiles_mb << 20);
+    else
+        obj = new canvas(field, packed);
+
+    auto stats_start = last_frame_start;
+    std::size_t stats_frames = 0, stats_uploaded = series::uploaded;
     while (running)
     {
         for (SDL_Event event; SDL_PollEvent(&event);) switch (event.type)
@@ -117,6 +270,17 @@ int main() try
                 obj->mouse_update();
             }
             break;
+        case SDL_MOUSEMOTION:
+            if (event.motion.state & SDL_BUTTON_MMASK)
+                obj->pan(event.motion.xrel, event.motion.yrel);
+            break;
+        case SDL_MOUSEWHEEL:
+            {
+                int mouse_x, mouse_y;
+                SDL_GetMouseState(&mouse_x, &mouse_y);
+                obj->zoom(event.wheel.y, mouse_x, mouse_y);
+            }
+            break;
         case SDL_KEYDOWN:
             if (event.key.keysym.sym == SDLK_LEFT)
             {
@@ -150,6 +314,31 @@ int main() try
         obj->draw();
 
         SDL_GL_SwapWindow(window);
+
+        if (first_frame)
+        {
+            // cold start compiles every program, warm start takes them from the cache
+            glFinish();
+            first_frame = false;
+            std::cerr << "first frame in " << std::chrono::duration_cast<std::chrono::duration<float, std::milli>>(
+                std::chrono::high_resolution_clock::now() - startup).count() << " ms ("
+                << program_cache.loaded << " programs cached, "
+                << program_cache.compiled << " compiled)" << std::endl;
+        }
+
+        ++stats_frames;
+        if (stats && now - stats_start >= std::chrono::seconds(1))
+        {
+            float seconds = std::chrono::duration_cast<std::chrono::duration<float>>(now - stats_start).count();
+            std::cerr << stats_frames / seconds << " fps, "
+                << (series::uploaded - stats_uploaded) / stats_frames << " bytes uploaded per frame";
+            if (auto line = obj->stats(); !line.empty())
+                std::cerr << ", " << line;
+            std::cerr << std::endl;
+            stats_start = now;
+            stats_frames = 0;
+            stats_uploaded = series::uploaded;
+        }
     }
     delete obj;
     SDL_GL_DeleteContext(gl_context);
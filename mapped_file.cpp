@@ -0,0 +1,77 @@
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.hpp"
+
+mapped_file::mapped_file(const std::filesystem::path &path, const std::string &what) {
+#ifdef WIN32
+    file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Can't open " + what + ": " + path.generic_string());
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file, &file_size);
+    length = std::size_t(file_size.QuadPart);
+    if (length == 0) {
+        CloseHandle(file);
+        throw std::runtime_error("Empty " + what + ": " + path.generic_string());
+    }
+    mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping)
+        data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error("Can't map " + what + ": " + path.generic_string());
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Can't open " + what + ": " + path.generic_string());
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("Empty " + what + ": " + path.generic_string());
+    }
+    length = std::size_t(st.st_size);
+    data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        data = nullptr;
+        throw std::runtime_error("Can't map " + what + ": " + path.generic_string());
+    }
+#endif
+}
+
+mapped_file::~mapped_file() {
+#ifdef WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(mapping);
+    CloseHandle(file);
+#else
+    munmap(data, length);
+#endif
+}
+
+void mapped_file::prefetch(const void *from, std::size_t count) const {
+#ifdef WIN32
+    WIN32_MEMORY_RANGE_ENTRY range = { const_cast<void *>(from), count };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    // madvise wants the start on a page boundary
+    const std::uintptr_t page = sysconf(_SC_PAGESIZE);
+    auto start = reinterpret_cast<std::uintptr_t>(from);
+    auto aligned = start / page * page;
+    madvise(reinterpret_cast<void *>(aligned), count + (start - aligned), MADV_WILLNEED);
+#endif
+}
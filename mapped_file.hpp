@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <filesystem>
+
+// read-only mapping of a whole file
+class mapped_file {
+private:
+	void *data = nullptr;
+	std::size_t length = 0;
+#ifdef WIN32
+	void *file = nullptr, *mapping = nullptr;
+#endif
+
+public:
+	// what names the file in errors: "Can't open <what>: <path>"
+	mapped_file(const std::filesystem::path &path, const std::string &what);
+	~mapped_file();
+
+	mapped_file(const mapped_file &) = delete;
+	mapped_file &operator=(const mapped_file &) = delete;
+
+	const unsigned char *bytes() const {
+		return static_cast<const unsigned char *>(data);
+	}
+
+	std::size_t size() const {
+		return length;
+	}
+
+	// hint that these bytes are needed soon
+	void prefetch(const void *from, std::size_t count) const;
+};
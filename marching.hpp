@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <utility>
+
+#include "functions.hpp"
+
+// Edges of the cell (x, y) where an isoline vertex can lie.
+// Edges on the upper and left border of the grid belong to cells with y == -1 or x == -1.
+enum edge_kind : std::uint32_t {
+	edge_right = 0, // (x + 1, y) - (x + 1, y + 1)
+	edge_below = 1, // (x, y + 1) - (x + 1, y + 1)
+	edge_diag = 2   // (x, y + 1) - (x + 1, y)
+};
+
+// vertex position in cells, t goes from the first end of the edge to the second
+inline vec2 edge_point(int x, int y, edge_kind kind, float t) {
+	switch (kind) {
+	case edge_right:
+		return vec2(x + 1, y + t);
+	case edge_below:
+		return vec2(x + t, y + 1);
+	default:
+		return vec2(x + t, y + 1 - t);
+	}
+}
+
+// Packed vertex: edge (x + 1 : 15 bits, y + 1 : 15 bits, edge_kind : 2 bits) + part of the edge,
+// six bytes instead of eight; packed_vertex.glsl unpacks it on the GPU.
+inline std::uint32_t pack_edge(int x, int y, edge_kind kind) {
+	return std::uint32_t(x + 1) | (std::uint32_t(y + 1) << 15) | (std::uint32_t(kind) << 30);
+}
+
+inline std::uint16_t pack_part(float t) {
+	return std::uint16_t(std::min(std::max(t, 0.f), 1.f) * 65535 + 0.5f);
+}
+
+inline vec2 unpack_point(std::uint32_t edge, std::uint16_t part) {
+	return edge_point(int(edge & 0x7FFF) - 1, int((edge >> 15) & 0x7FFF) - 1,
+		edge_kind(edge >> 30), part / 65535.f);
+}
+
+// Marching triangles over a (w + 1) x (h + 1) grid of values, every cell is split
+// by the diagonal from the left-down to the right-up corner.
+// Vertices are handed to emit(), which returns their index; shared vertices are
+// emitted once and ind gets a pair of indexes per segment.
+// The grid goes row by row, so only two rows of values are needed at once.
+class marching {
+protected:
+	int w = 0,
+		h = 0;
+
+	std::vector<std::uint32_t> ind;
+	// where the segments of every level begin in ind, one more for the end
+	std::vector<std::size_t> starts;
+
+	virtual std::uint32_t emit(int x, int y, edge_kind kind, float t) = 0;
+
+	// vertices on the lower edges of the last row, w per level,
+	// indexes of vertices that were not written in the last row are garbage
+	std::vector<std::uint32_t> &links() {
+		return below;
+	}
+
+private:
+	std::vector<std::uint32_t> below;
+	std::uint32_t right = 0;
+
+	static float part(float v_1, float v_2, float c) {
+		return (c - v_1) / (v_2 - v_1);
+	}
+
+	typedef void (marching:: *procedure_t)(int x, int y, std::uint32_t *links, float c,
+		const float *upper, const float *lower);
+
+	void process_initial_above(int x, int y, std::uint32_t *links, float c, const float *upper, const float *lower) {
+		ind.push_back(emit(x, -1, edge_below, part(upper[x], upper[x + 1], c)));
+	}
+
+	void process_initial_left(int x, int y, std::uint32_t *links, float c, const float *upper, const float *lower) {
+		ind.push_back(emit(-1, y, edge_right, part(upper[0], lower[0], c)));
+	}
+
+	void process_simple_above(int x, int y, std::uint32_t *links, float c, const float *upper, const float *lower) {
+		ind.push_back(links[x]);
+	}
+
+	void process_simple_left(int x, int y, std::uint32_t *links, float c, const float *upper, const float *lower) {
+		ind.push_back(right);
+	}
+
+	void process_right(int x, int y, std::uint32_t *links, float c, const float *upper, const float *lower) {
+		right = emit(x, y, edge_right, part(upper[x + 1], lower[x + 1], c));
+		ind.push_back(right);
+	}
+
+	void process_below(int x, int y, std::uint32_t *links, float c, const float *upper, const float *lower) {
+		links[x] = emit(x, y, edge_below, part(lower[x], lower[x + 1], c));
+		ind.push_back(links[x]);
+	}
+
+	void process_diag(int x, int y, std::uint32_t *links, float c, const float *upper, const float *lower) {
+		std::uint32_t i = emit(x, y, edge_diag, part(lower[x], upper[x + 1], c));
+		ind.push_back(i);
+		ind.push_back(i);
+	}
+
+	static constexpr procedure_t procedures[4] = {
+		&marching::process_initial_above,
+		&marching::process_simple_above,
+		&marching::process_initial_left,
+		&marching::process_simple_left
+	};
+
+	void process_ceil(float c, const float *upper, const float *lower, std::uint32_t *links,
+		int x, int y, int above_func, int left_func) {
+		bool slu = upper[x] > c, sld = lower[x] > c,
+			sru = upper[x + 1] > c, srd = lower[x + 1] > c;
+		if (sru ^ sld) {
+			// there is point on diag
+			if (slu ^ sru)
+				//above
+				(this->*procedures[above_func])(x, y, links, c, upper, lower);
+			else
+				// left
+				(this->*procedures[left_func])(x, y, links, c, upper, lower);
+
+			// on diag
+			process_diag(x, y, links, c, upper, lower);
+
+			if (srd ^ sru) {
+				// right
+				process_right(x, y, links, c, upper, lower);
+			}
+			else {
+				// below
+				process_below(x, y, links, c, upper, lower);
+			}
+		}
+		else {
+			// there is no point on diag
+			if (slu ^ sru) {
+				// there is line in upper triangle
+				(this->*procedures[above_func])(x, y, links, c, upper, lower);
+				(this->*procedures[left_func])(x, y, links, c, upper, lower);
+			}
+			if (srd ^ sru) {
+				// there is line in lower triangle
+				process_right(x, y, links, c, upper, lower);
+				process_below(x, y, links, c, upper, lower);
+			}
+		}
+	}
+
+	void process_row(std::size_t level, float c, const float *upper, const float *lower, int y) {
+		std::uint32_t *links = below.data() + level * w;
+		int above_func = y == 0 ? 0 : 1;
+		// first ceil
+		process_ceil(c, upper, lower, links, 0, y, above_func, 2);
+		for (int x = 1; x < w; ++x)
+			process_ceil(c, upper, lower, links, x, y, above_func, 3);
+	}
+
+public:
+	virtual ~marching() = default;
+
+	void set_grid(int width, int height) {
+		w = width;
+		h = height;
+	}
+
+	// appends isolines of every level to ind, level after level
+	void march(const std::vector<float> &values, const std::vector<float> &consts) {
+		below.resize(w);
+		starts.clear();
+		for (auto c : consts) {
+			starts.push_back(ind.size());
+			for (int y = 0; y < h; ++y)
+				process_row(0, c, values.data() + y * (w + 1), values.data() + (y + 1) * (w + 1), y);
+		}
+		starts.push_back(ind.size());
+	}
+
+	// appends isolines of every level between rows y and y + 1 of values,
+	// rows have to go one after another from y == 0
+	void march_row(const float *upper, const float *lower, int y, const std::vector<float> &consts) {
+		below.resize(consts.size() * w);
+		starts.clear();
+		for (std::size_t level = 0; level < consts.size(); ++level) {
+			starts.push_back(ind.size());
+			process_row(level, consts[level], upper, lower, y);
+		}
+		starts.push_back(ind.size());
+	}
+};
+
+// keeps vertices as positions in cells
+class contour : public marching {
+private:
+	std::uint32_t emit(int x, int y, edge_kind kind, float t) override {
+		points.push_back(edge_point(x, y, kind, t));
+		return points.size() - 1;
+	}
+
+public:
+	std::vector<vec2> points;
+
+	const std::vector<std::uint32_t> &indexes() const {
+		return ind;
+	}
+
+	// where every level begins in indexes(), see march
+	const std::vector<std::size_t> &levels() const {
+		return starts;
+	}
+
+	void clear() {
+		points.clear();
+		ind.clear();
+	}
+};
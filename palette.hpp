@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+// color scale of the fields
+class palette {
+private:
+	static constexpr std::uint8_t top[3] = {
+		255, 224, 47
+	};
+	static constexpr std::uint8_t tm[3] = {
+		188, 255, 47
+	};
+	static constexpr std::uint8_t middle[3] = {
+		47, 188, 255
+	};
+	static constexpr std::uint8_t mb[3] = {
+		255, 47, 188
+	};
+	static constexpr std::uint8_t bottom[3] = {
+		253, 94, 83
+	};
+
+	static std::uint8_t interpolate(std::uint8_t left, std::uint8_t right, float t) {
+		return left + (right - left) * t;
+	}
+
+public:
+	// every channel changes by less than 255 over a quarter of the range,
+	// so values closer than this are at most one step apart in every channel
+	static float tolerance(float left_bound, float right_bound) {
+		return (right_bound - left_bound) / (4 * 255);
+	}
+
+	static void paint(std::uint8_t *to_change, float z, float left_bound, float right_bound) {
+		z = 4 * (z - left_bound) / (right_bound - left_bound) - 2;
+		if (z <= -1) {
+			to_change[0] = interpolate(bottom[0], mb[0], 2 + z);
+			to_change[1] = interpolate(bottom[1], mb[1], 2 + z);
+			to_change[2] = interpolate(bottom[2], mb[2], 2 + z);
+		}
+		else if (z <= 0) {
+			to_change[0] = interpolate(mb[0], middle[0], 1 + z);
+			to_change[1] = interpolate(mb[1], middle[1], 1 + z);
+			to_change[2] = interpolate(mb[2], middle[2], 1 + z);
+		}
+		else if (z <= 1) {
+			to_change[0] = interpolate(middle[0], tm[0], z);
+			to_change[1] = interpolate(middle[1], tm[1], z);
+			to_change[2] = interpolate(middle[2], tm[2], z);
+		}
+		else {
+			to_change[0] = interpolate(tm[0], top[0], z - 1);
+			to_change[1] = interpolate(tm[1], top[1], z - 1);
+			to_change[2] = interpolate(tm[2], top[2], z - 1);
+		}
+		to_change[3] = 1;
+	}
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// work(part, from, to) on [0, count) cut into equal parts, part 0 runs in the calling thread
+template <class F>
+void parallel_for(std::size_t count, std::size_t threads, F work) {
+	std::vector<std::thread> pool;
+	for (std::size_t i = 1; i < threads; ++i)
+		pool.emplace_back(work, i, i * count / threads, (i + 1) * count / threads);
+	work(0, 0, count / threads);
+	for (auto &t : pool)
+		t.join();
+}
+
+// threads worth starting for count items when one thread should get at least chunk of them
+inline std::size_t count_of_threads(std::size_t count, std::size_t chunk) {
+	std::size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+	return std::max<std::size_t>(1, std::min(hardware, count / chunk));
+}
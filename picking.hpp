@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "functions.hpp"
+#include "parallel.hpp"
+
+// Uniform bucket grid over segments (pairs of indexes into points).
+// A segment goes to the bucket of its middle, queries look further by the
+// longest half of a segment. Built with a parallel counting sort, so it is
+// cheap enough to build again for every frame.
+class segment_index {
+private:
+	const std::vector<vec2> *points = nullptr;
+	const std::vector<std::uint32_t> *ind = nullptr;
+
+	float left = 0, top = 0, size = 1, reach = 0;
+	int columns = 0, rows = 0;
+	// segments of bucket b are items[offsets[b]] ... items[offsets[b + 1] - 1]
+	std::vector<std::uint32_t> offsets;
+	std::vector<std::uint32_t> items;
+	std::vector<std::uint32_t> buckets;
+	std::vector<std::vector<std::uint32_t>> counts;
+
+	// segments per thread below which threads cost more than they give
+	static const std::size_t chunk = 1 << 14;
+
+	int column(float x) const {
+		return std::min(columns - 1, std::max(0, int((x - left) / size)));
+	}
+
+	int row(float y) const {
+		return std::min(rows - 1, std::max(0, int((y - top) / size)));
+	}
+
+	static float distance2(const vec2 &p, const vec2 &a, const vec2 &b) {
+		vec2 ab = b - a, ap = p - a;
+		float len = ab.x * ab.x + ab.y * ab.y,
+			t = len > 0 ? std::min(1.f, std::max(0.f, (ap.x * ab.x + ap.y * ab.y) / len)) : 0;
+		vec2 d = ap - ab * t;
+		return d.x * d.x + d.y * d.y;
+	}
+
+public:
+	void build(const std::vector<vec2> &vertices, const std::vector<std::uint32_t> &indexes) {
+		points = &vertices;
+		ind = &indexes;
+		std::size_t count = ind->size() / 2;
+		items.resize(count);
+		if (count == 0) {
+			columns = rows = 0;
+			offsets.assign(1, 0);
+			return;
+		}
+
+		float right = left = (*points)[0].x, bottom = top = (*points)[0].y;
+		for (auto &p : *points) {
+			left = std::min(left, p.x);
+			right = std::max(right, p.x);
+			top = std::min(top, p.y);
+			bottom = std::max(bottom, p.y);
+		}
+		// about two segments per bucket
+		float width = std::max(right - left, 1.f), height = std::max(bottom - top, 1.f);
+		size = std::max(std::sqrt(width * height * 2 / count), 1e-3f);
+		columns = int(width / size) + 1;
+		rows = int(height / size) + 1;
+
+		std::size_t threads = count_of_threads(count, chunk);
+		std::size_t total = std::size_t(columns) * rows;
+		counts.resize(threads);
+		buckets.resize(count);
+		std::vector<float> reaches(threads, 0);
+
+		// count segments of every bucket in every part
+		parallel_for(count, threads, [&](std::size_t part, std::size_t from, std::size_t to) {
+			auto &local = counts[part];
+			local.assign(total, 0);
+			float longest = 0;
+			for (std::size_t s = from; s < to; ++s) {
+				const vec2 &a = (*points)[(*ind)[2 * s]], &b = (*points)[(*ind)[2 * s + 1]];
+				vec2 m = (a + b) * 0.5f, d = b - a;
+				longest = std::max(longest, d.x * d.x + d.y * d.y);
+				buckets[s] = row(m.y) * columns + column(m.x);
+				++local[buckets[s]];
+			}
+			reaches[part] = std::sqrt(longest) / 2;
+		});
+		reach = *std::max_element(reaches.begin(), reaches.end());
+
+		// every part gets its own range inside every bucket
+		offsets.resize(total + 1);
+		std::uint32_t sum = 0;
+		for (std::size_t b = 0; b < total; ++b) {
+			offsets[b] = sum;
+			for (auto &local : counts) {
+				std::uint32_t n = local[b];
+				local[b] = sum;
+				sum += n;
+			}
+		}
+		offsets[total] = sum;
+
+		parallel_for(count, threads, [&](std::size_t part, std::size_t from, std::size_t to) {
+			auto &local = counts[part];
+			for (std::size_t s = from; s < to; ++s)
+				items[local[buckets[s]]++] = s;
+		});
+	}
+
+	// number of the nearest segment or -1 if there are none
+	std::int64_t nearest(const vec2 &p, float &distance) const {
+		std::int64_t best = -1;
+		float best2 = std::numeric_limits<float>::max();
+		if (columns == 0)
+			return best;
+
+		int cx = column(p.x), cy = row(p.y);
+		int cx_max = std::max(cx, columns - 1 - cx), cy_max = std::max(cy, rows - 1 - cy);
+		for (int r = 0; r <= std::max(cx_max, cy_max); ++r) {
+			// everything beyond this ring is farther than r buckets, minus the reach of segments
+			float bound = (r - 1) * size - reach;
+			if (best >= 0 && bound > 0 && bound * bound > best2)
+				break;
+			for (int y = cy - r; y <= cy + r; ++y) {
+				if (y < 0 || y >= rows)
+					continue;
+				// only the border of the ring
+				int step = (y == cy - r || y == cy + r) ? 1 : 2 * r;
+				for (int x = cx - r; x <= cx + r; x += std::max(step, 1)) {
+					if (x < 0 || x >= columns)
+						continue;
+					std::size_t b = std::size_t(y) * columns + x;
+					for (std::uint32_t i = offsets[b]; i < offsets[b + 1]; ++i) {
+						std::uint32_t s = items[i];
+						float d2 = distance2(p, (*points)[(*ind)[2 * s]], (*points)[(*ind)[2 * s + 1]]);
+						if (d2 < best2) {
+							best2 = d2;
+							best = s;
+						}
+					}
+				}
+			}
+		}
+		distance = std::sqrt(best2);
+		return best;
+	}
+
+	std::size_t count_of_buckets() const {
+		return offsets.empty() ? 0 : offsets.size() - 1;
+	}
+};
@@ -0,0 +1,118 @@
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "scene.hpp"
+
+static const char scene_magic[4] = { 'M', 'B', 'S', 'C' };
+static const std::uint32_t scene_version = 1;
+
+static const char *scene_names[] = { "circle", "segment", "parabola" };
+
+static std::size_t align8(std::size_t offset) {
+    return (offset + 7) & ~std::size_t(7);
+}
+
+scene_layout::scene_layout(std::uint64_t count) {
+    type = sizeof(scene_header);
+    params = align8(type + count * sizeof(std::uint8_t));
+    radius = align8(params + count * scene_params * sizeof(float));
+    weight = align8(radius + count * sizeof(float));
+    charge = align8(weight + count * sizeof(float));
+    size = charge + count * sizeof(std::int32_t);
+}
+
+void scene_data::add(scene_traectory kind, const float (&args)[scene_params],
+    float r, float w, int c) {
+    type.push_back(std::uint8_t(kind));
+    params.insert(params.end(), args, args + scene_params);
+    radius.push_back(r);
+    weight.push_back(w);
+    charge.push_back(c);
+}
+
+scene::scene(const std::filesystem::path &path) : file(path, "scene") {
+    const auto *bytes = file.bytes();
+    std::size_t length = file.size();
+    scene_header header = {};
+    if (length >= sizeof(header))
+        std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, scene_magic, 4) != 0
+        || header.version != scene_version)
+        throw std::runtime_error("Not a scene file: " + path.generic_string());
+
+    scene_layout layout(header.count);
+    if (header.count > length || layout.size > length)
+        throw std::runtime_error("Scene is truncated: " + path.generic_string());
+
+    count = header.count;
+    type = bytes + layout.type;
+    params = reinterpret_cast<const float *>(bytes + layout.params);
+    radius = reinterpret_cast<const float *>(bytes + layout.radius);
+    weight = reinterpret_cast<const float *>(bytes + layout.weight);
+    charge = reinterpret_cast<const std::int32_t *>(bytes + layout.charge);
+    for (std::size_t i = 0; i < count; ++i)
+        if (type[i] > std::uint8_t(scene_traectory::parabola))
+            throw std::runtime_error("Unknown traectory in scene: " + path.generic_string());
+}
+
+void write_scene(const std::filesystem::path &path, const scene_data &data) {
+    scene_layout layout(data.size());
+    std::vector<char> buffer(layout.size, 0);
+
+    scene_header header;
+    std::memcpy(header.magic, scene_magic, 4);
+    header.version = scene_version;
+    header.count = data.size();
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    std::memcpy(buffer.data() + layout.type, data.type.data(), data.type.size());
+    std::memcpy(buffer.data() + layout.params, data.params.data(), data.params.size() * sizeof(float));
+    std::memcpy(buffer.data() + layout.radius, data.radius.data(), data.radius.size() * sizeof(float));
+    std::memcpy(buffer.data() + layout.weight, data.weight.data(), data.weight.size() * sizeof(float));
+    std::memcpy(buffer.data() + layout.charge, data.charge.data(), data.charge.size() * sizeof(std::int32_t));
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open())
+        throw std::runtime_error("Can't write scene: " + path.generic_string());
+    out.write(buffer.data(), buffer.size());
+}
+
+scene_data parse_scene(std::istream &in) {
+    scene_data result;
+    std::string line;
+    for (std::size_t number = 1; std::getline(in, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream ss(line);
+        std::string name;
+        if (!(ss >> name))
+            continue;
+
+        int kind = 0;
+        while (kind < 3 && name != scene_names[kind])
+            ++kind;
+        float args[scene_params], r, w;
+        int c;
+        for (auto &arg : args)
+            ss >> arg;
+        ss >> r >> w >> c;
+        if (kind == 3 || !ss)
+            throw std::runtime_error("Bad scene line " + std::to_string(number) + ": " + line);
+        result.add(scene_traectory(kind), args, r, w, c);
+    }
+    return result;
+}
+
+void print_scene(std::ostream &out, const scene &s) {
+    // enough digits to read the same floats back
+    out << std::setprecision(std::numeric_limits<float>::max_digits10);
+    for (std::size_t i = 0; i < s.count; ++i) {
+        out << scene_names[s.type[i]];
+        for (std::size_t j = 0; j < scene_params; ++j)
+            out << ' ' << s.params[i * scene_params + j];
+        out << ' ' << s.radius[i] << ' ' << s.weight[i] << ' ' << s.charge[i] << '\n';
+    }
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <filesystem>
+
+#include "functions.hpp"
+#include "mapped_file.hpp"
+
+// Binary scene file:
+//   scene_header
+//   std::uint8_t  type[count]      - scene_traectory
+//   float         params[count][6] - arguments of the traectory constructor, speed is the last one
+//   float         radius[count]
+//   float         weight[count]
+//   std::int32_t  charge[count]
+// every array starts on an 8-byte boundary, all values are little endian
+
+enum class scene_traectory : std::uint8_t {
+	circle = 0,
+	segment = 1,
+	parabola = 2
+};
+
+struct scene_header {
+	char magic[4];
+	std::uint32_t version;
+	std::uint64_t count;
+};
+
+const std::size_t scene_params = 6;
+
+// offsets of the arrays from the beginning of the file
+struct scene_layout {
+	std::size_t type, params, radius, weight, charge, size;
+
+	explicit scene_layout(std::uint64_t count);
+};
+
+// builder for the writer and the converter
+struct scene_data {
+	std::vector<std::uint8_t> type;
+	std::vector<float> params;
+	std::vector<float> radius;
+	std::vector<float> weight;
+	std::vector<std::int32_t> charge;
+
+	std::size_t size() const { return type.size(); }
+
+	void add(scene_traectory kind, const float (&args)[scene_params],
+		float r, float w, int c);
+};
+
+// read-only view of a mapped scene file
+class scene {
+private:
+	mapped_file file;
+
+public:
+	std::size_t count = 0;
+	const std::uint8_t *type = nullptr;
+	const float *params = nullptr;
+	const float *radius = nullptr;
+	const float *weight = nullptr;
+	const std::int32_t *charge = nullptr;
+
+	explicit scene(const std::filesystem::path &path);
+
+	vec2 position(std::size_t i, float t) const {
+		const float *p = params + i * scene_params;
+		switch (scene_traectory(type[i])) {
+		case scene_traectory::circle:
+			return circle::at(t, p[0], p[1], p[2], p[3], p[4], p[5]);
+		case scene_traectory::segment:
+			return segment::at(t, p[0], p[1], p[2], p[3], p[4], p[5]);
+		default:
+			return parabola::at(t, p[0], p[1], p[2], p[3], p[4], p[5]);
+		}
+	}
+};
+
+void write_scene(const std::filesystem::path &path, const scene_data &data);
+
+// text format, one ball per line:
+//   <circle|segment|parabola> <6 traectory params> <radius> <weight> <charge>
+// '#' starts a comment
+scene_data parse_scene(std::istream &in);
+void print_scene(std::ostream &out, const scene &s);
+
+// metaballs that live in a mapped scene file, no allocations per ball
+class scene_metaballs : public metaball_field {
+private:
+	std::shared_ptr<scene> balls;
+	std::vector<float> xs, ys, inv_R2, cw;
+	// positions before the last update
+	std::vector<float> old_xs, old_ys;
+	int updates = 0;
+
+public:
+	scene_metaballs(std::shared_ptr<scene> system) : balls(system),
+		xs(system->count), ys(system->count), inv_R2(system->count), cw(system->count) {
+		for (std::size_t i = 0; i < balls->count; ++i) {
+			inv_R2[i] = 1 / (balls->radius[i] * balls->radius[i]);
+			cw[i] = balls->charge[i] * balls->weight[i];
+			add_to_bounds(balls->weight[i], balls->charge[i]);
+		}
+		finish_bounds();
+	}
+
+	float calc(float x, float y, float t) override {
+		float res = 0;
+		for (std::size_t i = 0; i < xs.size(); ++i) {
+			float dx = x - xs[i], dy = y - ys[i];
+			res += cw[i] * std::exp(-(dx * dx + dy * dy) * inv_R2[i]);
+		}
+		return res;
+	}
+
+	void update(float t) override {
+		old_xs.swap(xs);
+		old_ys.swap(ys);
+		xs.resize(old_xs.size());
+		ys.resize(old_ys.size());
+		updates = std::min(updates + 1, 2);
+		for (std::size_t i = 0; i < xs.size(); ++i) {
+			vec2 p = balls->position(i, t);
+			// whole pixels like traectory, so a scene file draws the same as the built-in scene
+			xs[i] = int(p.x);
+			ys[i] = int(p.y);
+		}
+	}
+
+	float change_bound(float left, float top, float right, float bottom) const override {
+		if (updates < 2)
+			return std::numeric_limits<float>::infinity();
+		float res = 0;
+		for (std::size_t i = 0; i < xs.size(); ++i)
+			res += moved_bound(vec2(old_xs[i], old_ys[i]), vec2(xs[i], ys[i]), 1 / inv_R2[i], balls->weight[i],
+				left, top, right, bottom);
+		return res;
+	}
+
+	float period() const override {
+		std::vector<float> periods(balls->count);
+		for (std::size_t i = 0; i < balls->count; ++i)
+			periods[i] = traectory::period_of(balls->params[i * scene_params + 5]);
+		return common_period(periods);
+	}
+};
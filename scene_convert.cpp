@@ -0,0 +1,68 @@
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "scene.hpp"
+
+// scene_convert <scene.txt> <scene.bin>       - text to binary
+// scene_convert --dump <scene.bin>            - binary to text
+// scene_convert --random <count> <scene.bin>  - random scene for benchmarks
+
+static scene_data random_scene(std::size_t count) {
+    std::mt19937 gen(count);
+    std::uniform_real_distribution<float> x(0, 1920), y(0, 1080), angle(0, 2 * PI),
+        speed(0.3f, 3), size(20, 300), radius(20, 150), weight(0.5f, 3);
+    std::uniform_int_distribution<int> kind(0, 2), sign(0, 1);
+
+    scene_data result;
+    for (std::size_t i = 0; i < count; ++i) {
+        switch (scene_traectory(kind(gen))) {
+        case scene_traectory::circle:
+            result.add(scene_traectory::circle,
+                { size(gen), x(gen), y(gen), angle(gen), sign(gen) ? 1.f : -1.f, speed(gen) },
+                radius(gen), weight(gen), sign(gen) ? 1 : -1);
+            break;
+        case scene_traectory::segment:
+            result.add(scene_traectory::segment,
+                { x(gen), y(gen), x(gen), y(gen), angle(gen), speed(gen) },
+                radius(gen), weight(gen), sign(gen) ? 1 : -1);
+            break;
+        default:
+            result.add(scene_traectory::parabola,
+                { x(gen), y(gen), size(gen), sign(gen) ? size(gen) : -size(gen), angle(gen), speed(gen) },
+                radius(gen), weight(gen), sign(gen) ? 1 : -1);
+        }
+    }
+    return result;
+}
+
+int main(int argc, char **argv) try
+{
+    std::string mode = argc > 1 ? argv[1] : "";
+    if (argc == 3 && mode == "--dump") {
+        scene s(argv[2]);
+        print_scene(std::cout, s);
+    }
+    else if (argc == 4 && mode == "--random") {
+        write_scene(argv[3], random_scene(std::stoul(argv[2])));
+    }
+    else if (argc == 3) {
+        std::ifstream in(argv[1]);
+        if (!in.is_open())
+            throw std::runtime_error("Can't open " + mode);
+        write_scene(argv[2], parse_scene(in));
+    }
+    else {
+        std::cerr << "usage: " << argv[0] << " <scene.txt> <scene.bin>\n"
+            << "       " << argv[0] << " --dump <scene.bin>\n"
+            << "       " << argv[0] << " --random <count> <scene.bin>\n";
+        return EXIT_FAILURE;
+    }
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
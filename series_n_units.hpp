@@ -11,14 +11,31 @@
 #include <string>
 #include <filesystem>
 #include <cstddef>
+#include <chrono>
+#include <iostream>
 
 #include "functions.hpp"
+#include "marching.hpp"
+#include "tiles.hpp"
+#include "picking.hpp"
+#include "palette.hpp"
+#include "volume.hpp"
+#include "bake.hpp"
 
 namespace fs = std::filesystem;
 
-std::string load_shader(const std::filesystem::path& path);
+const char *find_shader(const std::string &name);
 GLuint create_shader(GLenum type, const char* source);
 GLuint create_program(GLuint vertex_shader, GLuint fragment_shader);
+// links the program or takes it from the on-disk program binary cache
+GLuint cached_program(const char *vertex_source, const char *fragment_source);
+
+struct program_cache_stats {
+	int loaded = 0;
+	int compiled = 0;
+};
+
+extern program_cache_stats program_cache;
 
 
 class vertex
@@ -40,58 +57,83 @@ private:
 	std::vector<GLuint> vbos;
 	GLuint program;
 	GLuint view_location, time_location;
-	static float view[16];
+	float view[16] = {
+		1.f, 0.f, 0.f, 0.f,
+		0.f, 1.f, 0.f, 0.f,
+		0.f, 0.f, 1.f, 0.f,
+		0.f, 0.f, 0.f, 1.f
+	};
 
 protected:
 	static float time;
-	static int swidth, sheight;
+	int swidth = 0, sheight = 0;
 
 	// 0 - vertex
 	// 1 - fragment
 	// to be continued...
-	static GLuint make_program(const std::vector<std::string> &paths) {
-		std::vector<GLuint> shaders(2);
-		shaders[0] = create_shader(GL_VERTEX_SHADER, load_shader(paths[0]).c_str());
-		shaders[1] = create_shader(GL_FRAGMENT_SHADER, load_shader(paths[1]).c_str());
-		return create_program(shaders[0], shaders[1]);
+	static GLuint make_program(const std::vector<std::string> &names) {
+		return cached_program(find_shader(names[0]), find_shader(names[1]));
 	}
 
 	virtual GLuint load_program() { return 0; }
+
+	GLint uniform_location(const char *name) {
+		return glGetUniformLocation(program, name);
+	}
+
+	// called with the program in use, before every draw
+	virtual void set_uniforms() {}
 	virtual void attrib_structure(GLuint ind) {
 		glBindVertexArray(vao);
 		glBindBuffer(GL_ARRAY_BUFFER, vbos[ind]);
 	}
 	void load_data(const std::vector<std::size_t> &to_be_upd,
-		GLsizeiptr size, void *data) {
+		GLsizeiptr size, const void *data) {
 		glBindVertexArray(vao);
 		std::size_t i = 0;
 		for (auto ind : to_be_upd) {
 			glBindBuffer(GL_ARRAY_BUFFER, vbos[ind]);
 			glBufferData(GL_ARRAY_BUFFER, size, data, GL_DYNAMIC_DRAW);
+			uploaded += size;
 			++i;
 		}
 	}
 
-	void load_indexes(GLsizeiptr size, void *indexes) {
+	void load_indexes(GLsizeiptr size, const void *indexes) {
+		glBindVertexArray(vao);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ind);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, indexes, GL_DYNAMIC_DRAW);
+		uploaded += size;
 	}
 
-	void draw(std::size_t count, GLenum mode) {
+	GLuint buffer(std::size_t ind) const {
+		return vbos[ind];
+	}
+
+	void use() {
 		glUseProgram(program);
 		glUniformMatrix4fv(view_location, 1, GL_TRUE, view);
 		glUniform1f(time_location, time);
+		set_uniforms();
 		glBindVertexArray(vao);
+	}
+
+	void draw(std::size_t count, GLenum mode) {
+		use();
 		glBindBuffer(GL_ARRAY_BUFFER, vbos[0]);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ind);
 		glDrawElements(mode, count, GL_UNSIGNED_INT, nullptr);
 	}
 
+	// one call for every copy, the shader tells them apart by gl_InstanceID
+	void draw(std::size_t count, GLenum mode, std::size_t instances) {
+		use();
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ind);
+		glDrawElementsInstanced(mode, count, GL_UNSIGNED_INT, nullptr, instances);
+	}
+
 	void druw(std::size_t count, std::size_t first) {
-		glUseProgram(program);
-		glUniformMatrix4fv(view_location, 1, GL_TRUE, view);
-		glUniform1f(time_location, time);
-		glBindVertexArray(vao);
+		use();
 		//glBindBuffer(GL_ARRAY_BUFFER, vbos[0]);
 		glDrawArrays(GL_LINE_STRIP, first, count);
 	}
@@ -108,6 +150,9 @@ public:
 
 	virtual ~series() {}
 
+	// bytes sent by glBufferData since the start
+	static std::size_t uploaded;
+
 	// left button
 	virtual void mouse_update(int mouse_x, int mouse_y) {}
 	// right button
@@ -116,6 +161,13 @@ public:
 	virtual void key_update(int dir) {}
 	// up-down arrow
 	virtual void key_update(int dir, bool dummy) {}
+	// drag with the middle button, in pixels
+	virtual void pan(int dx, int dy) {}
+	// mouse wheel
+	virtual void zoom(int dir, int mouse_x, int mouse_y) {}
+
+	// one line for --stats
+	virtual std::string stats() const { return ""; }
 
 	// I need normal animation system aaaaaaaaa
 	virtual void resize(int width, int height) {
@@ -133,6 +185,17 @@ public:
 		view[7] = 1.f;
 	}
 
+	// row-major, like the one resize makes
+	void set_view(const float *matrix) {
+		std::copy_n(matrix, 16, view);
+	}
+
+	// point (x, y) goes to the upper left corner of the window
+	void look_at(float x, float y) {
+		view[3] = -1.f - 2 * x / swidth;
+		view[7] = 1.f + 2 * y / sheight;
+	}
+
 	// so so so so
 	virtual void resize(int sparsity) {}
 
@@ -143,211 +206,305 @@ public:
 	virtual void draw() {}
 };
 
-class isolines : public series {
+class isolines : public series, private marching {
+	using marching::ind;
+
 	std::shared_ptr<function> f;
+	bool packed;
+
+	// plain format
 	std::vector<vec2> points;
-	std::vector<std::uint32_t> ind;
-	std::vector<std::pair<std::uint32_t, std::uint32_t>> grid;
 
-	int cx = 0,
-		cy = 0,
-		w = 0,
-		h = 0;
+	// packed format, see pack_edge
+	std::vector<std::uint32_t> edges;
+	std::vector<std::uint16_t> parts;
 
-	vec2 find_point(float x_1, float y_1, float x_2, float y_2, float v_1, float v_2, float c) {
-		return vec2(x_1 * cx, y_1 * cy).interpolate(vec2(x_2 * cx, y_2 * cy), (c - v_1) / (v_2 - v_1));
-	}
+	// nearest isoline queries over the last build_isolines
+	segment_index index;
+	std::vector<vec2> index_points;
+	float index_time = 0;
 
-	typedef void (isolines:: *procedure_t)(int x, int y, int lu, float c, const std::vector<float> &values);
+	int cx = 0,
+		cy = 0;
+	// origin of the current grid in cells
+	int ox = 0,
+		oy = 0;
+	GLuint cell_location;
+	std::size_t count_of_indexes = 0;
 
-	void process_initial_above(int x, int y, int lu, float c, const std::vector<float> &values) {
-		ind.push_back(points.size());
-		points.push_back(find_point(x, 0, x + 1, 0, values[lu], values[lu + 1], c));
+	static GLuint choose_program(bool packed) {
+		if (packed)
+			return series::make_program({ "packed_vertex", "std_fragment" });
+		return series::make_program({ "std_vertex", "std_fragment" });
 	}
 
-	void process_initial_left(int x, int y, int lu, float c, const std::vector<float> &values) {
-		ind.push_back(points.size());
-		points.push_back(find_point(0, y, 0, y + 1, values[lu], values[lu + w + 1], c));
+	std::uint32_t emit(int x, int y, edge_kind kind, float t) override {
+		x += ox;
+		y += oy;
+		if (packed) {
+			edges.push_back(pack_edge(x, y, kind));
+			parts.push_back(pack_part(t));
+			return edges.size() - 1;
+		}
+		vec2 p = edge_point(x, y, kind, t);
+		points.push_back(vec2(p.x * cx, p.y * cy));
+		return points.size() - 1;
 	}
 
-	void process_simple_above(int x, int y, int lu, float c, const std::vector<float> &values) {
-		ind.push_back(grid[lu - w - 1].second);
-	}
+	void attrib_structure(GLuint dummy = 0) override {
+		series::attrib_structure(0);
+		glEnableVertexAttribArray(0);
+		if (packed) {
+			glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, 0, ( void * )(0));
 
-	void process_simple_left(int x, int y, int lu, float c, const std::vector<float> &values) {
-		ind.push_back(grid[lu - 1].first);
+			series::attrib_structure(1);
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 1, GL_UNSIGNED_SHORT, GL_TRUE, 0, ( void * )(0));
+		}
+		else
+			glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, ( void * )(0));
 	}
 
-	void process_right(int x, int y, int lu, float c, const std::vector<float> &values) {
-		ind.push_back(points.size());
-		grid[lu].first = points.size();
-		points.push_back(find_point(x + 1, y, x + 1, y + 1, values[lu + 1], values[lu + w + 2], c));
+	void set_uniforms() override {
+		glUniform2f(cell_location, cx, cy);
 	}
 
-	void process_below(int x, int y, int lu, float c, const std::vector<float> &values) {
-		ind.push_back(points.size());
-		grid[lu].second = points.size();
-		points.push_back(find_point(x, y + 1, x + 1, y + 1, values[lu + w + 1], values[lu + w + 2], c));
+public:
+	isolines(std::shared_ptr<function> func, bool packed = false) :
+		series(choose_program(packed), packed ? 2 : 1), f(func), packed(packed) {
+		cell_location = series::uniform_location("cell");
+		attrib_structure();
 	}
 
-	void process_diag(int x, int y, int lu, float c, const std::vector<float> &values) {
-		ind.push_back(points.size());	
-		ind.push_back(points.size());
-		points.push_back(find_point(x, y + 1, x + 1, y, values[lu + w + 1], values[lu + 1], c));
+	using series::resize;
+
+	void resize(int ceil_width, int ceil_height, int width, int height) {
+		cx = ceil_width;
+		cy = ceil_height;
+		set_grid(width, height);
 	}
 
-	procedure_t procedures [4];
+	void clear() {
+		points.clear();
+		edges.clear();
+		parts.clear();
+		ind.clear();
+	}
 
-	void process_ceil(float c, const std::vector<float> &values, int x, int y,
-		int above_func, int left_func) {
-		int lu = y * (w + 1) + x, ru = lu + 1, ld = lu + w + 1, rd = ld + 1;
-		bool slu = values[lu] > c, sld = values[ld] > c,
-			sru = values[ru] > c, srd = values[rd] > c;
-		if (sru ^ sld) {
-			// there is point on diag
-			if (slu ^ sru)
-				//above
-				(this->*procedures[above_func])(x, y, lu, c, values);
-			else
-				// left
-				(this->*procedures[left_func])(x, y, lu, c, values);
+	// isolines of one more grid, shifted by (origin_x, origin_y) cells
+	void add(const std::vector<float> &values, const std::vector<float> &consts,
+		int origin_x = 0, int origin_y = 0) {
+		ox = origin_x;
+		oy = origin_y;
+		march(values, consts);
+	}
 
-			// on diag
-			process_diag(x, y, lu, c, values);
+	// ready isolines in cells, plain format only
+	void add(const std::vector<vec2> &cell_points, const std::vector<std::uint32_t> &indexes,
+		int origin_x, int origin_y) {
+		std::uint32_t base = points.size();
+		for (auto &p : cell_points)
+			points.push_back(vec2((p.x + origin_x) * cx, (p.y + origin_y) * cy));
+		for (auto i : indexes)
+			ind.push_back(base + i);
+	}
 
-			if (srd ^ sru) {
-				// right
-				process_right(x, y, lu, c, values);
-			}
-			else {
-				// below
-				process_below(x, y, lu, c, values);
-			}
+	// ready isolines of many grids in cells, level after level like march puts them,
+	// so pick still knows the levels; plain format only
+	void add(const std::vector<const contour *> &grids, const std::vector<vec2> &origins,
+		std::size_t count_of_levels) {
+		std::vector<std::uint32_t> base(grids.size());
+		for (std::size_t i = 0; i < grids.size(); ++i) {
+			base[i] = points.size();
+			for (auto &p : grids[i]->points)
+				points.push_back(vec2((p.x + origins[i].x) * cx, (p.y + origins[i].y) * cy));
 		}
-		else {
-			// there is no point on diag
-			if (slu ^ sru) {
-				// there is line in upper triangle
-				(this->*procedures[above_func])(x, y, lu, c, values);
-				(this->*procedures[left_func])(x, y, lu, c, values);
-			}
-			if (srd ^ sru) {
-				// there is line in lower triangle
-				process_right(x, y, lu, c, values);
-				process_below(x, y, lu, c, values);
+		starts.clear();
+		for (std::size_t level = 0; level < count_of_levels; ++level) {
+			starts.push_back(ind.size());
+			for (std::size_t i = 0; i < grids.size(); ++i) {
+				auto &from = grids[i]->levels();
+				for (std::size_t j = from[level]; j < from[level + 1]; ++j)
+					ind.push_back(base[i] + grids[i]->indexes()[j]);
 			}
 		}
+		starts.push_back(ind.size());
 	}
 
-	void process_value(float c, const std::vector<float> &values) {
-		// first ceil
-		process_ceil(c, values, 0, 0, 0, 2);
-		// upper and left border
-		for (int x = 1; x < w; ++x)
-			process_ceil(c, values, x, 0, 0, 3);
-		for (int y = 1; y < h; ++y)
-			process_ceil(c, values, 0, y, 1, 2);
-
-		// inner ceils
-		for (int x = 1; x < w; ++x)
-			for (int y = 1; y < h; ++y)
-				process_ceil(c, values, x, y, 1, 3);
+	void upload() {
+		if (packed) {
+			series::load_data({ 0 }, sizeof(std::uint32_t) * edges.size(), edges.data());
+			series::load_data({ 1 }, sizeof(std::uint16_t) * parts.size(), parts.data());
+		}
+		else
+			series::load_data({ 0 }, sizeof(vec2) * points.size(), points.data());
+		series::load_indexes(sizeof(std::uint32_t) * ind.size(), ind.data());
+		count_of_indexes = ind.size();
 	}
 
-	void attrib_structure(GLuint dummy = 0) override {
-		series::attrib_structure(0);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, ( void * )(0));
+	// ready packed isolines from memory that isolines don't own, e.g. a mapped file,
+	// they go to the GPU without a copy and can't be picked
+	void upload(const std::uint32_t *edge_data, const std::uint16_t *part_data, std::size_t count,
+		const std::uint32_t *indexes, std::size_t count_of_ind) {
+		series::load_data({ 0 }, sizeof(std::uint32_t) * count, edge_data);
+		series::load_data({ 1 }, sizeof(std::uint16_t) * count, part_data);
+		series::load_indexes(sizeof(std::uint32_t) * count_of_ind, indexes);
+		count_of_indexes = count_of_ind;
 	}
 
-public:
-	isolines(std::shared_ptr<function> &func) : series(series::make_program({
-			"shaders/std_vertex.glsl",
-			"shaders/std_fragment.glsl"
-		}), 1), f(func) {
-		attrib_structure();
-		procedures[0] = &isolines::process_initial_above;
-		procedures[1] = &isolines::process_simple_above;
-		procedures[2] = &isolines::process_initial_left;
-		procedures[3] = &isolines::process_simple_left;
+	void build_isolines(std::vector<float> &values) {
+		clear();
+		add(values, f->consts);
+		upload();
+		build_index();
 	}
 
-	void resize(int ceil_width, int ceil_height, int width, int height) {
-		cx = ceil_width;
-		cy = ceil_height;
-		w = width;
-		h = height;
-		grid.resize((w + 1) * (h + 1));
+	void build_index() {
+		auto start = std::chrono::high_resolution_clock::now();
+		if (packed) {
+			index_points.resize(edges.size());
+			for (std::size_t i = 0; i < edges.size(); ++i) {
+				vec2 p = unpack_point(edges[i], parts[i]);
+				index_points[i] = vec2(p.x * cx, p.y * cy);
+			}
+			index.build(index_points, ind);
+		}
+		else
+			index.build(points, ind);
+		index_time = std::chrono::duration_cast<std::chrono::duration<float, std::micro>>(
+			std::chrono::high_resolution_clock::now() - start).count();
 	}
 
-	void build_isolines(std::vector<float> &values) {
-		points.clear();
-		ind.clear();
+	// nearest isoline of the last build_isolines, false if there are none
+	bool pick(float x, float y, float &level, float &distance) const {
+		std::int64_t s = index.nearest(vec2(x, y), distance);
+		if (s < 0)
+			return false;
+		// starts of levels are sorted, the segment lies between two of them
+		auto it = std::upper_bound(starts.begin(), starts.end(), std::size_t(2 * s));
+		level = f->consts[it - starts.begin() - 1];
+		return true;
+	}
 
-		for (auto c : f->consts)
-			process_value(c, values);
-		
-		// loading
-		series::load_data({ 0 }, sizeof(vec2) * points.size(), points.data());
-		series::load_indexes(sizeof(std::uint32_t) * ind.size(), ind.data());
+	std::string index_stats() const {
+		return std::to_string(ind.size() / 2) + " segments in " + std::to_string(index.count_of_buckets())
+			+ " buckets, built in " + std::to_string(index_time) + " us";
 	}
 
 	void draw() override {
-		series::draw(ind.size(), GL_LINES);
+		series::draw(count_of_indexes, GL_LINES);
 	}
 };
 
+// Field over the window. Between frames most of the field barely changes, so the grid
+// is cut into blocks that are evaluated again only when the change bound of the function
+// says that one of their values could have crossed a level or changed its color.
 class canvas : public series {
 private:
+	static const int block_cells = 8;
+
+	struct block {
+		// cells of the block
+		int x, y, w, h;
+		// change of the field since the block was evaluated
+		float drift = 0;
+		// drift that can't be seen yet
+		float slack = 0;
+		bool evaluated = false;
+		// isolines in cells of the block, plain format only
+		contour lines;
+	};
+
 	isolines lines;
 	std::shared_ptr<function> f;
+	bool packed;
 	int wcount, hcount, sqsize;
 	std::vector<vertex> grid;
 	std::vector<std::uint32_t> indexes;
+	std::vector<float> values;
+	std::vector<block> blocks;
+	int wblocks = 0;
+	std::uint64_t revision = 0;
+	std::size_t evaluated = 0;
 
-	const std::uint8_t top[3] = {
-		255, 224, 47
-	};
-	const std::uint8_t tm[3] = {
-		188, 255, 47
-	};
-	const std::uint8_t middle[3] = {
-		47, 188, 255
-	};
-	const std::uint8_t mb[3] = {
-		255, 47, 188
-	};
-	const std::uint8_t bottom[3] = {
-		253, 94, 83
-	};
+	void color(std::uint8_t *to_change, float z) {
+		palette::paint(to_change, z, f->left_bound, f->right_bound);
+	}
 
-	std::uint8_t interpolate(std::uint8_t left, std::uint8_t right, float t) {
-		return left + (right - left) * t;
+	void build_blocks() {
+		wblocks = (wcount - 2) / block_cells + 1;
+		int hblocks = (hcount - 2) / block_cells + 1;
+		blocks.assign(wblocks * hblocks, block());
+		for (int i = 0; i < hblocks; ++i)
+			for (int j = 0; j < wblocks; ++j) {
+				auto &b = blocks[i * wblocks + j];
+				b.x = j * block_cells;
+				b.y = i * block_cells;
+				b.w = std::min(block_cells, wcount - 1 - b.x);
+				b.h = std::min(block_cells, hcount - 1 - b.y);
+				b.lines.set_grid(b.w, b.h);
+			}
+		values.resize(grid.size());
+		// nothing is evaluated yet
+		revision = f->revision - 1;
 	}
 
-	void color(std::uint8_t *to_change, float z) {
-		z = 4 * (z - f->left_bound) / (f->right_bound - f->left_bound) - 2;
-		if (z <= -1) {
-			to_change[0] = interpolate(bottom[0], mb[0], 2 + z);
-			to_change[1] = interpolate(bottom[1], mb[1], 2 + z);
-			to_change[2] = interpolate(bottom[2], mb[2], 2 + z);
-		}
-		else if (z <= 0) {
-			to_change[0] = interpolate(mb[0], middle[0], 1 + z);
-			to_change[1] = interpolate(mb[1], middle[1], 1 + z);
-			to_change[2] = interpolate(mb[2], middle[2], 1 + z);
-		}
-		else if (z <= 1) {
-			to_change[0] = interpolate(middle[0], tm[0], z);
-			to_change[1] = interpolate(middle[1], tm[1], z);
-			to_change[2] = interpolate(middle[2], tm[2], z);
+	void evaluate(block &b) {
+		for (int y = b.y; y <= b.y + b.h; ++y)
+			for (int x = b.x; x <= b.x + b.w; ++x) {
+				auto &v = grid[y * wcount + x];
+				values[y * wcount + x] = f->calc(v.position.x, v.position.y, series::time);
+				color(v.color, values[y * wcount + x]);
+			}
+		b.drift = 0;
+		b.evaluated = true;
+		++evaluated;
+	}
+
+	// values of the block can't cross a level or change color by more than a step while they
+	// drift less than this
+	float slack(const block &b, float tolerance) const {
+		float res = tolerance;
+		for (int y = b.y; y <= b.y + b.h; ++y)
+			for (int x = b.x; x <= b.x + b.w; ++x)
+				for (auto c : f->consts)
+					res = std::min(res, std::fabs(values[y * wcount + x] - c));
+		return res;
+	}
+
+	void march(block &b, std::vector<float> &part) {
+		part.resize((b.w + 1) * (b.h + 1));
+		for (int y = 0; y <= b.h; ++y)
+			std::copy_n(values.begin() + (b.y + y) * wcount + b.x, b.w + 1, part.begin() + y * (b.w + 1));
+		b.lines.clear();
+		b.lines.march(part, f->consts);
+	}
+
+	void build_isolines() {
+		if (packed) {
+			lines.build_isolines(values);
+			return;
 		}
-		else {
-			to_change[0] = interpolate(tm[0], top[0], z - 1);
-			to_change[1] = interpolate(tm[1], top[1], z - 1);
-			to_change[2] = interpolate(tm[2], top[2], z - 1);
+		// a block is marched again if it or a neighbour was evaluated, neighbours share the border
+		std::vector<float> part;
+		std::vector<const contour *> grids(blocks.size());
+		std::vector<vec2> origins(blocks.size());
+		for (std::size_t i = 0; i < blocks.size(); ++i) {
+			int bx = i % wblocks, by = i / wblocks;
+			bool touched = false;
+			for (int y = std::max(0, by - 1); y <= by + 1 && !touched; ++y)
+				for (int x = std::max(0, bx - 1); x <= std::min(wblocks - 1, bx + 1); ++x)
+					if (std::size_t(y * wblocks + x) < blocks.size() && blocks[y * wblocks + x].evaluated)
+						touched = true;
+			if (touched)
+				march(blocks[i], part);
+			grids[i] = &blocks[i].lines;
+			origins[i] = vec2(blocks[i].x, blocks[i].y);
 		}
-		to_change[3] = 1;
+		lines.clear();
+		lines.add(grids, origins, f->consts.size());
+		lines.upload();
+		lines.build_index();
 	}
 
 	void build_grid() {
@@ -378,6 +535,7 @@ private:
 		}
 
 		series::load_indexes(sizeof(std::uint32_t) * indexes.size(), indexes.data());
+		build_blocks();
 	}
 
 	void attrib_structure(GLuint dummy = 0) override {
@@ -391,31 +549,43 @@ private:
 			(void*)(offsetof(vertex, color)));
 	}
 public:
-	canvas(std::shared_ptr<function> Func) : series(series::make_program({
-			"shaders/canvas_vertex.glsl",
-			"shaders/canvas_fragment.glsl"
-		}), 2), f(Func), lines(Func) {
+	canvas(std::shared_ptr<function> Func, bool packed_lines = false) : series(series::make_program({
+			"canvas_vertex",
+			"canvas_fragment"
+		}), 2), lines(Func, packed_lines), f(Func), packed(packed_lines) {
 		sqsize = 15;
 		attrib_structure();
 	}
 
 	void draw() override {
-		std::vector<float> to_lines;
 		f->update(series::time);
-		for (auto it = grid.begin(); it != grid.end(); ++it) {
-			to_lines.push_back(f->calc((*it).position.x,
-				(*it).position.y, series::time));
-			color((*it).color, *to_lines.rbegin());
+		// new levels or a new shape of the function change everything
+		bool all = f->revision != revision;
+		revision = f->revision;
+		evaluated = 0;
+		for (auto &b : blocks) {
+			b.evaluated = false;
+			if (!all)
+				b.drift += f->change_bound(b.x * sqsize, b.y * sqsize,
+					(b.x + b.w) * sqsize, (b.y + b.h) * sqsize);
+			if (all || !(b.drift < b.slack))
+				evaluate(b);
+		}
+		if (evaluated > 0) {
+			float tolerance = palette::tolerance(f->left_bound, f->right_bound);
+			for (auto &b : blocks)
+				if (b.evaluated)
+					b.slack = slack(b, tolerance);
+			series::load_data({ 1 }, { GLsizeiptr(grid.size() * sizeof(vertex)) }, { grid.data() });
+			build_isolines();
 		}
-		series::load_data({ 1 }, { GLsizeiptr(grid.size() * sizeof(vertex)) }, { grid.data() });
 		series::draw(indexes.size(), GL_TRIANGLES);
-
-		lines.build_isolines(to_lines);
 		lines.draw();
 	}
 
 	void resize(int width, int height) override {
 		series::resize(width, height);
+		lines.resize(width, height);
 		wcount = width / sqsize + 2;
 		hcount = height / sqsize + 2;
 		build_grid();
@@ -433,4 +603,586 @@ public:
 	void key_update(int dir, bool dummy) {
 		f->update(dir);
 	}
+
+	void mouse_update(int mouse_x, int mouse_y) override {
+		auto start = std::chrono::high_resolution_clock::now();
+		float level, distance;
+		bool found = lines.pick(mouse_x, mouse_y, level, distance);
+		float query_time = std::chrono::duration_cast<std::chrono::duration<float, std::micro>>(
+			std::chrono::high_resolution_clock::now() - start).count();
+
+		std::cout << "(" << mouse_x << ", " << mouse_y << "): value "
+			<< f->calc(mouse_x, mouse_y, series::time);
+		if (found)
+			std::cout << ", isoline " << level << " at " << distance << " px";
+		std::cout << " (" << query_time << " us)" << std::endl;
+	}
+
+	void mouse_update() override {
+		std::cout << lines.index_stats() << std::endl;
+	}
+
+	std::string stats() const override {
+		return std::to_string(evaluated) + "/" + std::to_string(blocks.size()) + " blocks evaluated";
+	}
+};
+
+// Plays a baked animation back. Values of two frames go from the mapped file to
+// the GPU as they are and the shader blends them, isolines come from the nearest frame.
+class baked_canvas : public series {
+private:
+	isolines lines;
+	std::shared_ptr<baked> cache;
+	std::vector<vec2> grid;
+	std::vector<std::uint32_t> indexes;
+	// frames in the value buffers 1 and 2 and the frame of the isolines
+	std::size_t slots[2] = { SIZE_MAX, SIZE_MAX },
+		shown = SIZE_MAX;
+	// weight of the second buffer
+	float between = 0;
+	GLint between_location;
+
+	void attrib_structure(GLuint dummy = 0) override {
+		series::attrib_structure(0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)(0));
+
+		for (GLuint i = 1; i <= 2; ++i) {
+			series::attrib_structure(i);
+			glEnableVertexAttribArray(i);
+			glVertexAttribPointer(i, 1, GL_UNSIGNED_SHORT, GL_TRUE, 0, (void*)(0));
+		}
+	}
+
+	void set_uniforms() override {
+		glUniform1f(between_location, between);
+	}
+
+	void build_grid() {
+		int w = cache->header.width, h = cache->header.height, cell = cache->header.cell;
+		grid.resize(std::size_t(w) * h);
+		for (int i = 0; i < h; ++i)
+			for (int j = 0; j < w; ++j)
+				grid[i * w + j] = vec2(j * cell, i * cell);
+		series::load_data({ 0 }, GLsizeiptr(grid.size() * sizeof(vec2)), grid.data());
+
+		indexes.clear();
+		for (int i = 0; i + 1 < h; ++i)
+			for (int j = 0; j + 1 < w; ++j) {
+				std::uint32_t left = i * w + j;
+				indexes.insert(indexes.end(), {
+					left, left + 1, left + w,
+					left + w, left + 1, left + w + 1
+				});
+			}
+		series::load_indexes(sizeof(std::uint32_t) * indexes.size(), indexes.data());
+		lines.resize(cell, cell, w - 1, h - 1);
+	}
+
+	// a frame that is already in a buffer stays there
+	void show(std::size_t first, std::size_t second, float t) {
+		if (slots[0] == second || slots[1] == first) {
+			std::swap(first, second);
+			t = 1 - t;
+		}
+		for (int i = 0; i < 2; ++i) {
+			std::size_t frame = i == 0 ? first : second;
+			if (slots[i] == frame)
+				continue;
+			series::load_data({ std::size_t(i + 1) }, GLsizeiptr(grid.size() * sizeof(std::uint16_t)),
+				cache->values(frame));
+			slots[i] = frame;
+			// the next frame is read from the disk while this one is played
+			cache->prefetch((frame + 1) % cache->header.count_of_frames);
+		}
+		between = t;
+	}
+
+public:
+	baked_canvas(std::shared_ptr<baked> bake) : series(series::make_program({
+			"baked_vertex",
+			"canvas_fragment"
+		}), 3), lines(nullptr, true), cache(bake) {
+		between_location = series::uniform_location("between");
+		attrib_structure();
+		build_grid();
+	}
+
+	void draw() override {
+		std::size_t first, second;
+		float t = cache->locate(series::time, first, second);
+		show(first, second, t);
+		series::draw(indexes.size(), GL_TRIANGLES);
+
+		std::size_t nearest = t < 0.5f ? first : second;
+		if (nearest != shown) {
+			lines.upload(cache->edges(nearest), cache->parts(nearest), cache->frames[nearest].count_of_vertices,
+				cache->indexes(nearest), cache->frames[nearest].count_of_indexes);
+			shown = nearest;
+		}
+		lines.draw();
+	}
+
+	void resize(int width, int height) override {
+		series::resize(width, height);
+		lines.resize(width, height);
+	}
+
+	std::string stats() const override {
+		return "frame " + std::to_string(shown) + " of " + std::to_string(cache->header.count_of_frames);
+	}
+};
+
+// view state of one field of the dashboard
+struct panel {
+	std::shared_ptr<function> f;
+	float time_offset = 0;
+	// field units per pixel
+	float scale = 1;
+	// upper left corner in the window
+	int x = 0,
+		y = 0;
+};
+
+// A lot of small fields in one window. All panels share one grid and are drawn
+// by one instanced call, their isolines go to one buffer and are drawn by one more.
+class dashboard : public series {
+private:
+	isolines lines;
+	std::vector<panel> panels;
+	int sqsize = 6,
+		columns = 1,
+		wcells = 1,
+		hcells = 1;
+	std::vector<vec2> grid;
+	std::vector<std::uint32_t> indexes;
+	std::vector<float> values;
+	// rgba of every grid vertex, panel after panel
+	std::vector<std::uint8_t> colors;
+
+	GLuint colors_texture;
+	GLint colors_location, columns_location, vertices_location, slot_location;
+
+	void attrib_structure(GLuint dummy = 0) override {
+		series::attrib_structure(0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)(0));
+	}
+
+	void set_uniforms() override {
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_BUFFER, colors_texture);
+		glUniform1i(colors_location, 0);
+		glUniform1i(columns_location, columns);
+		glUniform1i(vertices_location, grid.size());
+		glUniform2f(slot_location, (wcells + 1) * sqsize, (hcells + 1) * sqsize);
+	}
+
+	void build_grid() {
+		int count = panels.size();
+		columns = std::ceil(std::sqrt(float(count)));
+		int rows = (count + columns - 1) / columns;
+		// one cell between panels
+		wcells = std::max(1, swidth / columns / sqsize - 1);
+		hcells = std::max(1, sheight / rows / sqsize - 1);
+
+		// every panel shows the whole window
+		float scale = std::max(float(swidth) / (wcells * sqsize), float(sheight) / (hcells * sqsize));
+		for (int i = 0; i < count; ++i) {
+			panels[i].scale = scale;
+			panels[i].x = (i % columns) * (wcells + 1) * sqsize;
+			panels[i].y = (i / columns) * (hcells + 1) * sqsize;
+		}
+
+		lines.resize(sqsize, sqsize, wcells, hcells);
+		grid.resize((wcells + 1) * (hcells + 1));
+		for (int i = 0; i <= hcells; ++i)
+			for (int j = 0; j <= wcells; ++j)
+				grid[i * (wcells + 1) + j] = vec2(j * sqsize, i * sqsize);
+		series::load_data({ 0 }, GLsizeiptr(grid.size() * sizeof(vec2)), grid.data());
+
+		indexes.clear();
+		for (int i = 0; i < hcells; ++i)
+			for (int j = 0; j < wcells; ++j) {
+				std::uint32_t left = i * (wcells + 1) + j;
+				indexes.insert(indexes.end(), {
+					left, left + 1, left + wcells + 1,
+					left + wcells + 1, left + 1, left + wcells + 2
+				});
+			}
+		series::load_indexes(sizeof(std::uint32_t) * indexes.size(), indexes.data());
+
+		values.resize(grid.size());
+		colors.resize(4 * grid.size() * count);
+	}
+
+public:
+	dashboard(const std::vector<panel> &fields, bool packed_lines = false) : series(series::make_program({
+			"panel_vertex",
+			"canvas_fragment"
+		}), 2), lines(nullptr, packed_lines), panels(fields) {
+		colors_location = series::uniform_location("colors");
+		columns_location = series::uniform_location("columns");
+		vertices_location = series::uniform_location("vertices");
+		slot_location = series::uniform_location("slot");
+		attrib_structure();
+
+		// a name from glGenBuffers becomes a buffer only when it is bound for the first time
+		glBindBuffer(GL_TEXTURE_BUFFER, series::buffer(1));
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		glGenTextures(1, &colors_texture);
+		glBindTexture(GL_TEXTURE_BUFFER, colors_texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA8, series::buffer(1));
+	}
+
+	~dashboard() {
+		glDeleteTextures(1, &colors_texture);
+	}
+
+	void draw() override {
+		lines.clear();
+		for (std::size_t k = 0; k < panels.size(); ++k) {
+			auto &p = panels[k];
+			float t = series::time + p.time_offset;
+			p.f->update(t);
+			std::uint8_t *color = colors.data() + 4 * grid.size() * k;
+			for (std::size_t i = 0; i < grid.size(); ++i, color += 4) {
+				values[i] = p.f->calc(grid[i].x * p.scale, grid[i].y * p.scale, t);
+				palette::paint(color, values[i], p.f->left_bound, p.f->right_bound);
+			}
+			lines.add(values, p.f->consts, p.x / sqsize, p.y / sqsize);
+		}
+
+		series::load_data({ 1 }, GLsizeiptr(colors.size()), colors.data());
+		series::draw(indexes.size(), GL_TRIANGLES, panels.size());
+
+		lines.upload();
+		lines.draw();
+	}
+
+	void resize(int width, int height) override {
+		series::resize(width, height);
+		lines.resize(width, height);
+		build_grid();
+	}
+
+	void key_update(int dir) override {
+		if (sqsize + dir > 0) {
+			sqsize += dir;
+			build_grid();
+		}
+	}
+
+	void key_update(int dir, bool dummy) override {
+		// panels may share one function
+		std::set<function *> done;
+		for (auto &p : panels)
+			if (done.insert(p.f.get()).second)
+				p.f->update(dir);
+	}
+};
+
+// Canvas over the whole plane: drag it with the middle button, zoom with the wheel.
+// The plane is cut into tiles. For time invariant functions the tiles keep values
+// and isolines in an LRU cache, so panning evaluates only the tiles that come into
+// view and nothing is evaluated again until the function changes. Functions of time
+// build the visible tiles every frame.
+class tiled_canvas : public series {
+private:
+	isolines lines;
+	std::shared_ptr<function> f;
+	tile_cache cache;
+	contour tracer;
+	int sqsize = 15,
+		zoom_level = 0;
+	// field point in the upper left corner of the window
+	float origin_x = 0,
+		origin_y = 0;
+	std::vector<vertex> vertices;
+	std::vector<std::uint32_t> indexes;
+	std::vector<tile_key> shown;
+
+	// ten times twice closer or farther: tile indexes stay far from the int range and
+	// cells of a tile stay far apart in floats
+	static const int max_zoom = 40;
+	// field units the window can go from zero, so that vertex positions of tiles,
+	// (index * tile_cells + j) * sqsize, fit in an int at any zoom
+	static constexpr float max_origin = 1e5f;
+
+	// field units per pixel, four levels for twice
+	float scale() const {
+		return std::pow(2.f, -zoom_level / 4.f);
+	}
+
+	tile build_tile(const tile_key &key) {
+		const int n = tile_cells + 1;
+		float step = sqsize * scale();
+		tile result;
+		result.values.resize(n * n);
+		result.colors.resize(4 * n * n);
+		for (int i = 0; i < n; ++i)
+			for (int j = 0; j < n; ++j) {
+				int k = i * n + j;
+				result.values[k] = f->calc((key.x * tile_cells + j) * step,
+					(key.y * tile_cells + i) * step, series::time);
+				palette::paint(&result.colors[4 * k], result.values[k], f->left_bound, f->right_bound);
+			}
+
+		tracer.clear();
+		tracer.march(result.values, f->consts);
+		result.points = tracer.points;
+		result.ind = tracer.indexes();
+		return result;
+	}
+
+	void append(const tile_key &key, const tile &t) {
+		const int n = tile_cells + 1;
+		std::uint32_t base = vertices.size();
+		for (int i = 0; i < n; ++i)
+			for (int j = 0; j < n; ++j) {
+				vertex v;
+				v.position = vec2((key.x * tile_cells + j) * sqsize, (key.y * tile_cells + i) * sqsize);
+				std::copy_n(&t.colors[4 * (i * n + j)], 4, v.color);
+				vertices.push_back(v);
+			}
+		for (int i = 0; i < tile_cells; ++i)
+			for (int j = 0; j < tile_cells; ++j) {
+				std::uint32_t left = base + i * n + j;
+				indexes.insert(indexes.end(), {
+					left, left + 1, left + n,
+					left + n, left + 1, left + n + 1
+				});
+			}
+		lines.add(t.points, t.ind, key.x * tile_cells, key.y * tile_cells);
+	}
+
+	void attrib_structure(GLuint dummy = 0) override {
+		series::attrib_structure(0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)(0));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(vertex),
+			(void*)(offsetof(vertex, color)));
+	}
+
+public:
+	tiled_canvas(std::shared_ptr<function> Func, std::size_t cache_bytes) : series(series::make_program({
+			"canvas_vertex",
+			"canvas_fragment"
+		}), 1), lines(Func), f(Func), cache(cache_bytes) {
+		tracer.set_grid(tile_cells, tile_cells);
+		attrib_structure();
+	}
+
+	void draw() override {
+		bool invariant = f->time_invariant();
+		if (!invariant)
+			f->update(series::time);
+
+		float s = scale(), size = tile_cells * sqsize * s;
+		int left = std::floor(origin_x / size), right = std::floor((origin_x + swidth * s) / size),
+			top = std::floor(origin_y / size), bottom = std::floor((origin_y + sheight * s) / size);
+
+		std::vector<tile_key> visible;
+		for (int y = top; y <= bottom; ++y)
+			for (int x = left; x <= right; ++x)
+				visible.push_back({ zoom_level, x, y, f->revision });
+
+		// tiles of a function that changes with time are never seen again, so they skip the cache
+		if (!invariant || visible != shown) {
+			vertices.clear();
+			indexes.clear();
+			lines.clear();
+			for (auto &key : visible) {
+				if (!invariant) {
+					append(key, build_tile(key));
+					continue;
+				}
+				const tile *t = cache.find(key);
+				if (!t)
+					t = &cache.insert(key, build_tile(key));
+				append(key, *t);
+			}
+			series::load_data({ 0 }, GLsizeiptr(vertices.size() * sizeof(vertex)), vertices.data());
+			series::load_indexes(sizeof(std::uint32_t) * indexes.size(), indexes.data());
+			lines.upload();
+			shown = std::move(visible);
+		}
+
+		look_at(origin_x / s, origin_y / s);
+		lines.look_at(origin_x / s, origin_y / s);
+		series::draw(indexes.size(), GL_TRIANGLES);
+		lines.draw();
+	}
+
+	void resize(int width, int height) override {
+		series::resize(width, height);
+		lines.resize(width, height);
+		lines.resize(sqsize, sqsize, tile_cells, tile_cells);
+		shown.clear();
+	}
+
+	void pan(int dx, int dy) override {
+		origin_x = std::min(max_origin, std::max(-max_origin, origin_x - dx * scale()));
+		origin_y = std::min(max_origin, std::max(-max_origin, origin_y - dy * scale()));
+	}
+
+	void zoom(int dir, int mouse_x, int mouse_y) override {
+		if (std::abs(zoom_level + dir) > max_zoom)
+			return;
+		// the point under the mouse stays in place
+		float x = origin_x + mouse_x * scale(), y = origin_y + mouse_y * scale();
+		zoom_level += dir;
+		origin_x = x - mouse_x * scale();
+		origin_y = y - mouse_y * scale();
+	}
+
+	void key_update(int dir) override {
+		if (sqsize + dir > 0) {
+			sqsize += dir;
+			lines.resize(sqsize, sqsize, tile_cells, tile_cells);
+			// cells of every cached tile have another size now
+			cache.clear();
+			shown.clear();
+		}
+	}
+
+	void key_update(int dir, bool dummy) override {
+		f->update(dir);
+	}
+
+	std::string stats() const override {
+		return std::to_string(cache.size()) + " tiles, " + std::to_string(cache.memory() >> 10)
+			+ " KB cached, " + std::to_string(cache.hits) + " hits, " + std::to_string(cache.misses) + " misses";
+	}
+};
+
+// Isosurfaces of 3D metaballs at the levels of the field.
+// Drag with the middle button to turn the box, the wheel moves the camera.
+class volume_view : public series {
+private:
+	std::shared_ptr<metaballs3d> f;
+	isosurface surface;
+	int sqsize = 20;
+	float yaw = 0,
+		pitch = 0.4f,
+		distance = 2.5f;
+	float build_time = 0;
+
+	static void multiply(const float *a, const float *b, float *res) {
+		for (int i = 0; i < 4; ++i)
+			for (int j = 0; j < 4; ++j) {
+				res[i * 4 + j] = 0;
+				for (int k = 0; k < 4; ++k)
+					res[i * 4 + j] += a[i * 4 + k] * b[k * 4 + j];
+			}
+	}
+
+	void update_view() {
+		float size = std::max(swidth, sheight), s = 2 / size;
+		// field units to a box around zero, y goes up
+		float model[16] = {
+			s, 0.f, 0.f, -swidth / size,
+			0.f, -s, 0.f, sheight / size,
+			0.f, 0.f, s, 0.f,
+			0.f, 0.f, 0.f, 1.f
+		};
+		float cy = std::cos(yaw), sy = std::sin(yaw), cp = std::cos(pitch), sp = std::sin(pitch);
+		// turn around y, then around x, then move away
+		float camera[16] = {
+			cy, 0.f, sy, 0.f,
+			sp * sy, cp, -sp * cy, 0.f,
+			-cp * sy, sp, cp * cy, -distance,
+			0.f, 0.f, 0.f, 1.f
+		};
+		float z_near = 0.1f, z_far = 100.f, focus = 1 / std::tan(PI / 8), aspect = float(swidth) / sheight;
+		float projection[16] = {
+			focus / aspect, 0.f, 0.f, 0.f,
+			0.f, focus, 0.f, 0.f,
+			0.f, 0.f, (z_near + z_far) / (z_near - z_far), 2 * z_near * z_far / (z_near - z_far),
+			0.f, 0.f, -1.f, 0.f
+		};
+		float tmp[16], res[16];
+		multiply(camera, model, tmp);
+		multiply(projection, tmp, res);
+		set_view(res);
+	}
+
+	void build_box() {
+		// as deep as high
+		surface.set_box(vec3(0, 0, -sheight / 2.f), sqsize,
+			swidth / sqsize + 1, sheight / sqsize + 1, sheight / sqsize + 1);
+	}
+
+	void attrib_structure(GLuint dummy = 0) override {
+		series::attrib_structure(0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(isosurface::vertex),
+			(void*)(offsetof(isosurface::vertex, position)));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(isosurface::vertex),
+			(void*)(offsetof(isosurface::vertex, normal)));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(isosurface::vertex),
+			(void*)(offsetof(isosurface::vertex, color)));
+	}
+
+public:
+	volume_view(std::shared_ptr<metaballs3d> Func) : series(series::make_program({
+			"volume_vertex",
+			"volume_fragment"
+		}), 1), f(Func) {
+		attrib_structure();
+	}
+
+	void draw() override {
+		auto start = std::chrono::high_resolution_clock::now();
+		f->update(series::time);
+		surface.build(*f);
+		build_time = std::chrono::duration_cast<std::chrono::duration<float, std::milli>>(
+			std::chrono::high_resolution_clock::now() - start).count();
+
+		series::load_data({ 0 }, GLsizeiptr(surface.vertices.size() * sizeof(isosurface::vertex)),
+			surface.vertices.data());
+		series::load_indexes(sizeof(std::uint32_t) * surface.triangles.size(), surface.triangles.data());
+
+		glEnable(GL_DEPTH_TEST);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		series::draw(surface.triangles.size(), GL_TRIANGLES);
+		glDisable(GL_DEPTH_TEST);
+	}
+
+	void resize(int width, int height) override {
+		series::resize(width, height);
+		update_view();
+		build_box();
+	}
+
+	void pan(int dx, int dy) override {
+		yaw += dx * 0.01f;
+		pitch = std::min(1.5f, std::max(-1.5f, pitch + dy * 0.01f));
+		update_view();
+	}
+
+	void zoom(int dir, int mouse_x, int mouse_y) override {
+		distance = std::min(20.f, std::max(0.5f, distance * std::pow(0.9f, float(dir))));
+		update_view();
+	}
+
+	void key_update(int dir) override {
+		if (sqsize + dir > 1) {
+			sqsize += dir;
+			build_box();
+		}
+	}
+
+	void key_update(int dir, bool dummy) override {
+		f->update(dir);
+	}
+
+	std::string stats() const override {
+		return std::to_string(surface.triangles.size() / 3) + " triangles, "
+			+ std::to_string(surface.active_bricks) + "/" + std::to_string(surface.count_of_bricks)
+			+ " bricks, built in " + std::to_string(build_time) + " ms";
+	}
 };
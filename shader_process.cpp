@@ -1,29 +1,142 @@
+#include <cstdlib>
 #include <fstream>
+#include <iomanip>
+#include <iterator>
 #include <sstream>
 #include <stdexcept>
 
 #include "series_n_units.hpp"
-
-float series::view[16] = {
-    1.f, 0.f, 0.f, 0.f,
-    0.f, 1.f, 0.f, 0.f,
-    0.f, 0.f, 1.f, 0.f,
-    0.f, 0.f, 0.f, 1.f
-};
+#include "embedded_shaders.hpp"
 
 float series::time = 0.f;
 
-int series::swidth = 0, series::sheight = 0;
-
-std::string load_shader(const std::filesystem::path& path) {
-    std::ifstream shader_file;
-    shader_file.open(path);
-    if (!shader_file.is_open())
-        throw std::exception(("Can't find shader in: " + path.generic_string()).data());
-    std::stringstream ss;
-    ss << shader_file.rdbuf();
-    shader_file.close();
-    return ss.str();
+std::size_t series::uploaded = 0;
+
+program_cache_stats program_cache;
+
+const char *find_shader(const std::string &name) {
+    for (auto &shader : embedded_shaders)
+        if (name == shader.name)
+            return shader.source;
+    throw std::runtime_error("Unknown shader: " + name);
+}
+
+static bool binary_cache_supported() {
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+        return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+static fs::path binary_cache_dir() {
+    if (const char *dir = std::getenv("ISOLINES_CACHE"))
+        return dir;
+#ifdef WIN32
+    if (const char *dir = std::getenv("LOCALAPPDATA"))
+        return fs::path(dir) / "cool_isolines";
+#else
+    if (const char *dir = std::getenv("XDG_CACHE_HOME"))
+        return fs::path(dir) / "cool_isolines";
+    if (const char *dir = std::getenv("HOME"))
+        return fs::path(dir) / ".cache" / "cool_isolines";
+#endif
+    return fs::temp_directory_path() / "cool_isolines";
+}
+
+// FNV-1a
+static void hash_string(std::uint64_t &hash, const char *str) {
+    for (; str && *str; ++str) {
+        hash ^= std::uint8_t(*str);
+        hash *= 1099511628211ull;
+    }
+    hash ^= 0xff;
+    hash *= 1099511628211ull;
+}
+
+// the driver may refuse binaries of another driver or version, so both are in the key
+static fs::path binary_cache_file(const char *vertex_source, const char *fragment_source) {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION })
+        hash_string(hash, reinterpret_cast<const char *>(glGetString(name)));
+    hash_string(hash, vertex_source);
+    hash_string(hash, fragment_source);
+
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hash << ".bin";
+    return binary_cache_dir() / name.str();
+}
+
+static GLuint load_program_binary(const fs::path &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return 0;
+    GLenum format;
+    if (!file.read(reinterpret_cast<char *>(&format), sizeof(format)))
+        return 0;
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (binary.empty())
+        return 0;
+
+    GLuint result = glCreateProgram();
+    glProgramBinary(result, format, binary.data(), binary.size());
+    GLint status;
+    glGetProgramiv(result, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        // driver update or corrupted file, fall back to the sources
+        glDeleteProgram(result);
+        return 0;
+    }
+    return result;
+}
+
+static void save_program_binary(const fs::path &path, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+    std::error_code error;
+    fs::create_directories(path.parent_path(), error);
+    // write to a temporary file first so a crash doesn't leave a broken entry
+    fs::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary);
+        if (!file.is_open())
+            return;
+        file.write(reinterpret_cast<const char *>(&format), sizeof(format));
+        file.write(binary.data(), binary.size());
+        if (!file)
+            return;
+    }
+    fs::rename(tmp, path, error);
+}
+
+GLuint cached_program(const char *vertex_source, const char *fragment_source) {
+    bool use_cache = binary_cache_supported();
+    fs::path path;
+    if (use_cache) {
+        path = binary_cache_file(vertex_source, fragment_source);
+        if (GLuint result = load_program_binary(path)) {
+            ++program_cache.loaded;
+            return result;
+        }
+    }
+
+    GLuint vertex_shader = create_shader(GL_VERTEX_SHADER, vertex_source);
+    GLuint fragment_shader = create_shader(GL_FRAGMENT_SHADER, fragment_source);
+    GLuint result = create_program(vertex_shader, fragment_shader);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+    ++program_cache.compiled;
+
+    if (use_cache)
+        save_program_binary(path, result);
+    return result;
 }
 
 GLuint create_shader(GLenum type, const char* source)
@@ -49,6 +162,8 @@ GLuint create_program(GLuint vertex_shader, GLuint fragment_shader)
     GLuint result = glCreateProgram();
     glAttachShader(result, vertex_shader);
     glAttachShader(result, fragment_shader);
+    if (binary_cache_supported())
+        glProgramParameteri(result, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(result);
 
     GLint status;
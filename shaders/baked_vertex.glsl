@@ -0,0 +1,36 @@
+#version 330 core
+
+uniform mat4 view;
+uniform float time;
+// weight of the second frame
+uniform float between;
+
+layout (location = 0) in vec2 in_position;
+// values of two frames, 0 is left_bound and 1 is right_bound
+layout (location = 1) in float in_first;
+layout (location = 2) in float in_second;
+
+out vec4 color;
+
+// the scale of palette.hpp
+const vec3 top = vec3(255.0, 224.0, 47.0) / 255.0;
+const vec3 tm = vec3(188.0, 255.0, 47.0) / 255.0;
+const vec3 middle = vec3(47.0, 188.0, 255.0) / 255.0;
+const vec3 mb = vec3(255.0, 47.0, 188.0) / 255.0;
+const vec3 bottom = vec3(253.0, 94.0, 83.0) / 255.0;
+
+void main()
+{
+    gl_Position = view * vec4(in_position, 0.0, 1.0);
+    float z = 4.0 * mix(in_first, in_second, between) - 2.0;
+    vec3 rgb;
+    if (z <= -1.0)
+        rgb = mix(bottom, mb, 2.0 + z);
+    else if (z <= 0.0)
+        rgb = mix(mb, middle, 1.0 + z);
+    else if (z <= 1.0)
+        rgb = mix(middle, tm, z);
+    else
+        rgb = mix(tm, top, z - 1.0);
+    color = vec4(rgb, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#!/usr/bin/env python3
+# Packs shaders/*.glsl into one header: python3 shaders/embed.py <out.hpp>
+# The build runs it, the header is not kept in the repository.
+
+import pathlib
+import sys
+
+here = pathlib.Path(__file__).resolve().parent
+
+lines = [
+    '// generated by shaders/embed.py from shaders/*.glsl at build time, do not edit',
+    '#pragma once',
+    '',
+    'struct embedded_shader {',
+    '\tconst char *name;',
+    '\tconst char *source;',
+    '};',
+    '',
+    'const embedded_shader embedded_shaders[] = {',
+]
+for path in sorted(here.glob('*.glsl')):
+    source = path.read_text().replace('\r\n', '\n')
+    if not source.endswith('\n'):
+        source += '\n'
+    lines.append('\t{ "%s", R"glsl(%s)glsl" },' % (path.stem, source))
+lines += ['};', '']
+
+out = pathlib.Path(sys.argv[1])
+out.parent.mkdir(parents=True, exist_ok=True)
+out.write_text('\n'.join(lines))
@@ -0,0 +1,26 @@
+#version 330 core
+
+uniform mat4 view;
+uniform float time;
+uniform vec2 cell;
+
+layout (location = 0) in uint in_edge;
+layout (location = 1) in float in_part;
+
+out vec4 color;
+
+void main()
+{
+    // see edge_kind in marching.hpp
+    vec2 corner = vec2(float(in_edge & 0x7FFFu), float((in_edge >> 15) & 0x7FFFu)) - 1.0;
+    uint kind = in_edge >> 30;
+    vec2 offset;
+    if (kind == 0u)
+        offset = vec2(1.0, in_part);
+    else if (kind == 1u)
+        offset = vec2(in_part, 1.0);
+    else
+        offset = vec2(in_part, 1.0 - in_part);
+    gl_Position = view * vec4((corner + offset) * cell, 0.0, 1.0);
+    color = vec4(0.0, 0.0, 0.0, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#version 330 core
+
+uniform mat4 view;
+uniform float time;
+// rgba of every grid vertex of every panel
+uniform samplerBuffer colors;
+uniform int columns;
+uniform int vertices;
+// panel size with the gap
+uniform vec2 slot;
+
+layout (location = 0) in vec2 in_position;
+
+out vec4 color;
+
+void main()
+{
+    vec2 origin = vec2(gl_InstanceID % columns, gl_InstanceID / columns) * slot;
+    gl_Position = view * vec4(origin + in_position, 0.0, 1.0);
+    color = texelFetch(colors, gl_InstanceID * vertices + gl_VertexID);
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 330 core
+
+in vec3 normal;
+in vec4 color;
+
+layout (location = 0) out vec4 out_color;
+
+void main()
+{
+    // both sides of a surface are lit, the light comes from the viewer side of the field
+    float light = 0.35 + 0.65 * abs(dot(normalize(normal), normalize(vec3(0.3, -0.5, 0.8))));
+    out_color = vec4(color.rgb * light, 1.0);
+}
\ No newline at end of file
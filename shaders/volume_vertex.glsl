@@ -0,0 +1,18 @@
+#version 330 core
+
+uniform mat4 view;
+uniform float time;
+
+layout (location = 0) in vec3 in_position;
+layout (location = 1) in vec3 in_normal;
+layout (location = 2) in vec4 in_color;
+
+out vec3 normal;
+out vec4 color;
+
+void main()
+{
+    gl_Position = view * vec4(in_position, 1.0);
+    normal = in_normal;
+    color = in_color;
+}
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "functions.hpp"
+
+const int tile_cells = 32;
+
+struct tile_key {
+	int zoom, x, y;
+	std::uint64_t revision;
+
+	bool operator==(const tile_key &oth) const {
+		return zoom == oth.zoom && x == oth.x && y == oth.y
+			&& revision == oth.revision;
+	}
+};
+
+struct tile_key_hash {
+	std::size_t operator()(const tile_key &key) const {
+		std::uint64_t h = std::uint32_t(key.x);
+		h = h * 0x9E3779B97F4A7C15ull ^ std::uint32_t(key.y);
+		h = h * 0x9E3779B97F4A7C15ull ^ std::uint32_t(key.zoom);
+		h = h * 0x9E3779B97F4A7C15ull ^ key.revision;
+		return std::size_t(h ^ (h >> 32));
+	}
+};
+
+// tile_cells x tile_cells cells of the field with their isolines
+struct tile {
+	// (tile_cells + 1) x (tile_cells + 1) values and their rgba
+	std::vector<float> values;
+	std::vector<std::uint8_t> colors;
+	// isolines in cells of the tile
+	std::vector<vec2> points;
+	std::vector<std::uint32_t> ind;
+
+	std::size_t bytes() const {
+		return sizeof(tile) + values.capacity() * sizeof(float) + colors.capacity()
+			+ points.capacity() * sizeof(vec2) + ind.capacity() * sizeof(std::uint32_t);
+	}
+};
+
+// least recently used tiles go away first when the cache is over its limit
+class tile_cache {
+private:
+	typedef std::list<std::pair<tile_key, tile>> list_t;
+
+	std::size_t limit, used = 0;
+	list_t order;
+	std::unordered_map<tile_key, list_t::iterator, tile_key_hash> index;
+
+	void evict() {
+		// the newest tile is kept even if it alone is over the limit
+		while (used > limit && order.size() > 1) {
+			used -= order.back().second.bytes();
+			index.erase(order.back().first);
+			order.pop_back();
+		}
+	}
+
+public:
+	std::size_t hits = 0,
+		misses = 0;
+
+	explicit tile_cache(std::size_t limit_bytes) : limit(limit_bytes) {}
+
+	// nullptr if there is no such tile
+	const tile *find(const tile_key &key) {
+		auto it = index.find(key);
+		if (it == index.end()) {
+			++misses;
+			return nullptr;
+		}
+		++hits;
+		order.splice(order.begin(), order, it->second);
+		return &it->second->second;
+	}
+
+	// the reference lives until the next insert
+	const tile &insert(const tile_key &key, tile &&value) {
+		auto it = index.find(key);
+		if (it != index.end()) {
+			used -= it->second->second.bytes();
+			order.erase(it->second);
+			index.erase(it);
+		}
+		order.emplace_front(key, std::move(value));
+		index[key] = order.begin();
+		used += order.front().second.bytes();
+		evict();
+		return order.front().second;
+	}
+
+	void clear() {
+		order.clear();
+		index.clear();
+		used = 0;
+	}
+
+	std::size_t size() const {
+		return order.size();
+	}
+
+	std::size_t memory() const {
+		return used;
+	}
+};
@@ -0,0 +1,381 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "functions.hpp"
+#include "palette.hpp"
+#include "parallel.hpp"
+
+class vec3 {
+public:
+	float x;
+	float y;
+	float z;
+
+	vec3() = default;
+	vec3(float x, float y, float z) : x(x), y(y), z(z) {}
+
+	vec3 operator*(float s) const {
+		return vec3(x * s, y * s, z * s);
+	}
+
+	vec3 operator+(const vec3 &oth) const {
+		return vec3(x + oth.x, y + oth.y, z + oth.z);
+	}
+
+	vec3 operator-(const vec3 &oth) const {
+		return vec3(x - oth.x, y - oth.y, z - oth.z);
+	}
+
+	vec3 interpolate(const vec3 &oth, float t) const {
+		return (*this) * (1 - t) + oth * t;
+	}
+};
+
+// (x, y) goes along the top traectory, z is y of the side one
+class metaball3d {
+public:
+	std::shared_ptr<traectory> top, side;
+	float R2, w;
+	int c;
+	metaball3d(std::shared_ptr<traectory> top, std::shared_ptr<traectory> side,
+		float radius, float weight, int charge) :
+		top(top), side(side), R2(radius * radius), w(weight), c(charge) {}
+
+	vec3 position() const {
+		return vec3(top->x, top->y, side->y);
+	}
+};
+
+class metaballs3d : public metaball_field {
+private:
+	std::vector<metaball3d> balls;
+
+public:
+	metaballs3d(const std::vector<metaball3d> &system) : balls(system) {
+		for (auto &ball : balls)
+			add_to_bounds(ball.w, ball.c);
+		finish_bounds();
+	}
+
+	const std::vector<metaball3d> &system() const {
+		return balls;
+	}
+
+	// slice z == 0
+	float calc(float x, float y, float t) override {
+		return calc(vec3(x, y, 0));
+	}
+
+	float calc(const vec3 &p) const {
+		float res = 0;
+		for (auto &ball : balls) {
+			vec3 d = p - ball.position();
+			res += ball.c * ball.w * std::exp(-(d.x * d.x + d.y * d.y + d.z * d.z) / ball.R2);
+		}
+		return res;
+	}
+
+	void update(float t) override {
+		for (auto &ball : balls) {
+			ball.top->update(t);
+			ball.side->update(t);
+		}
+	}
+
+	// Balls are cut off at influence(), so the field differs from calc by less than
+	// tolerance times the level nearest to zero, everywhere; surfaces move by that
+	// error over the slope of the field.
+	float tolerance = 0.01f;
+
+	// every ball gives less than tolerance * smallest / count farther than this from its center
+	float influence(const metaball3d &ball) const {
+		float smallest = right_bound - left_bound;
+		for (auto c : consts)
+			smallest = std::min(smallest, std::abs(c));
+		float ratio = ball.w * balls.size() / (tolerance * smallest);
+		return ratio > 1 ? std::sqrt(ball.R2 * std::log(ratio)) : 0;
+	}
+};
+
+// Marching tetrahedra over a box of cubes with side step, split into bricks of
+// brick_cells^3 cubes. Only bricks that some ball can reach are evaluated, bricks
+// go in parallel, and vertices on the faces between bricks are merged afterwards.
+class isosurface {
+public:
+	struct vertex {
+		float position[3];
+		float normal[3];
+		std::uint8_t color[4];
+	};
+
+	static const int brick_cells = 16;
+
+	std::vector<vertex> vertices;
+	std::vector<std::uint32_t> triangles;
+
+	std::size_t count_of_bricks = 0,
+		active_bricks = 0;
+
+private:
+	// vertex of a brick before the merge
+	struct brick_vertex {
+		vertex v;
+		// edge and level, the same for all bricks
+		std::uint64_t key;
+		bool seam;
+	};
+
+	struct brick {
+		int x, y, z;
+		std::vector<std::uint32_t> balls;
+		std::vector<float> values;
+		std::vector<brick_vertex> vertices;
+		std::vector<std::uint32_t> triangles;
+		std::unordered_map<std::uint64_t, std::uint32_t> known;
+	};
+
+	vec3 origin = vec3(0, 0, 0);
+	float step = 1;
+	// box size in cubes and in bricks
+	int nx = 0, ny = 0, nz = 0;
+	int bx = 0, by = 0, bz = 0;
+	std::vector<brick> bricks;
+	std::vector<std::uint32_t> active;
+	// squared influence of every ball, it adds nothing farther, so that
+	// neighbour bricks get exactly the same values on their common face
+	std::vector<float> reach2;
+	std::unordered_map<std::uint64_t, std::uint32_t> seams;
+
+	// Kuhn split of the cube into six tetrahedra along the 0 - 7 diagonal,
+	// corner bits are x, y, z, so every edge goes from a corner to its superset
+	static constexpr int tetrahedra[6][4] = {
+		{ 0, 1, 3, 7 }, { 0, 3, 2, 7 }, { 0, 2, 6, 7 },
+		{ 0, 6, 4, 7 }, { 0, 4, 5, 7 }, { 0, 5, 1, 7 }
+	};
+
+	std::uint64_t point_id(int x, int y, int z) const {
+		return (std::uint64_t(z) * (ny + 1) + y) * (nx + 1) + x;
+	}
+
+	void evaluate(brick &b, const metaballs3d &f) {
+		const int n = brick_cells + 1;
+		auto &system = f.system();
+		b.values.resize(n * n * n);
+		for (int k = 0; k < n; ++k)
+			for (int j = 0; j < n; ++j)
+				for (int i = 0; i < n; ++i) {
+					vec3 p = origin + vec3(b.x * brick_cells + i, b.y * brick_cells + j, b.z * brick_cells + k) * step;
+					float res = 0;
+					for (auto id : b.balls) {
+						auto &ball = system[id];
+						vec3 d = p - ball.position();
+						float d2 = d.x * d.x + d.y * d.y + d.z * d.z;
+						if (d2 <= reach2[id])
+							res += ball.c * ball.w * std::exp(-d2 / ball.R2);
+					}
+					b.values[(k * n + j) * n + i] = res;
+				}
+	}
+
+	vec3 gradient(const brick &b, const metaballs3d &f, const vec3 &p) const {
+		vec3 res(0, 0, 0);
+		for (auto id : b.balls) {
+			auto &ball = f.system()[id];
+			vec3 d = p - ball.position();
+			float d2 = d.x * d.x + d.y * d.y + d.z * d.z;
+			if (d2 > reach2[id])
+				continue;
+			float e = ball.c * ball.w * std::exp(-d2 / ball.R2);
+			res = res - d * (2 * e / ball.R2);
+		}
+		return res;
+	}
+
+	std::uint32_t edge_vertex(brick &b, const metaballs3d &f, std::size_t level, float c,
+		int i, int j, int k, int from, int to, const std::uint8_t *color) {
+		const int n = brick_cells + 1;
+		int gx = b.x * brick_cells + i, gy = b.y * brick_cells + j, gz = b.z * brick_cells + k;
+		// 7 directions of edges, one per nonzero subset of the corner bits
+		std::uint64_t key = ((point_id(gx + (from & 1), gy + (from >> 1 & 1), gz + (from >> 2 & 1)) * 7
+			+ (to ^ from) - 1) * f.consts.size()) + level;
+		auto found = b.known.find(key);
+		if (found != b.known.end())
+			return found->second;
+
+		int li = i + (from & 1), lj = j + (from >> 1 & 1), lk = k + (from >> 2 & 1),
+			ri = i + (to & 1), rj = j + (to >> 1 & 1), rk = k + (to >> 2 & 1);
+		float v_1 = b.values[(lk * n + lj) * n + li], v_2 = b.values[(rk * n + rj) * n + ri];
+		vec3 p = origin + vec3(gx - i + li, gy - j + lj, gz - k + lk).interpolate(
+			vec3(gx - i + ri, gy - j + rj, gz - k + rk), (c - v_1) / (v_2 - v_1)) * step;
+		vec3 g = gradient(b, f, p);
+		float len = std::sqrt(g.x * g.x + g.y * g.y + g.z * g.z);
+		if (len > 0)
+			g = g * (-1 / len);
+
+		brick_vertex res;
+		res.v = { { p.x, p.y, p.z }, { g.x, g.y, g.z }, { color[0], color[1], color[2], 255 } };
+		res.key = key;
+		// the edge lies on a face of the brick if both ends do
+		auto on_face = [](int a, int b) { return (a == 0 && b == 0) || (a == brick_cells && b == brick_cells); };
+		res.seam = on_face(li, ri) || on_face(lj, rj) || on_face(lk, rk);
+		b.vertices.push_back(res);
+		b.known[key] = b.vertices.size() - 1;
+		return b.vertices.size() - 1;
+	}
+
+	void march(brick &b, const metaballs3d &f, const std::vector<std::array<std::uint8_t, 4>> &colors) {
+		const int n = brick_cells + 1;
+		b.vertices.clear();
+		b.triangles.clear();
+		b.known.clear();
+		evaluate(b, f);
+
+		for (std::size_t level = 0; level < f.consts.size(); ++level) {
+			float c = f.consts[level];
+			const std::uint8_t *color = colors[level].data();
+			for (int k = 0; k < brick_cells; ++k)
+				for (int j = 0; j < brick_cells; ++j)
+					for (int i = 0; i < brick_cells; ++i) {
+						bool inside[8];
+						int count = 0;
+						for (int corner = 0; corner < 8; ++corner) {
+							int ci = i + (corner & 1), cj = j + (corner >> 1 & 1), ck = k + (corner >> 2 & 1);
+							inside[corner] = b.values[(ck * n + cj) * n + ci] > c;
+							count += inside[corner];
+						}
+						if (count == 0 || count == 8)
+							continue;
+
+						for (auto &tet : tetrahedra) {
+							int in[4], out[4], ins = 0, outs = 0;
+							for (int corner : tet)
+								if (inside[corner])
+									in[ins++] = corner;
+								else
+									out[outs++] = corner;
+							if (ins == 0 || outs == 0)
+								continue;
+
+							auto vertex = [&](int a, int b_) {
+								return edge_vertex(b, f, level, c, i, j, k, std::min(a, b_), std::max(a, b_), color);
+							};
+							if (ins == 1 || outs == 1) {
+								// one corner against three
+								int lone = ins == 1 ? in[0] : out[0];
+								int *rest = ins == 1 ? out : in;
+								b.triangles.insert(b.triangles.end(), {
+									vertex(lone, rest[0]), vertex(lone, rest[1]), vertex(lone, rest[2])
+								});
+							}
+							else {
+								std::uint32_t ac = vertex(in[0], out[0]), ad = vertex(in[0], out[1]),
+									bd = vertex(in[1], out[1]), bc = vertex(in[1], out[0]);
+								b.triangles.insert(b.triangles.end(), { ac, ad, bd, ac, bd, bc });
+							}
+						}
+					}
+		}
+	}
+
+public:
+	void set_box(const vec3 &corner, float cube, int width, int height, int depth) {
+		origin = corner;
+		step = cube;
+		bx = (width + brick_cells - 1) / brick_cells;
+		by = (height + brick_cells - 1) / brick_cells;
+		bz = (depth + brick_cells - 1) / brick_cells;
+		nx = bx * brick_cells;
+		ny = by * brick_cells;
+		nz = bz * brick_cells;
+		bricks.resize(std::size_t(bx) * by * bz);
+		for (int z = 0; z < bz; ++z)
+			for (int y = 0; y < by; ++y)
+				for (int x = 0; x < bx; ++x) {
+					auto &b = bricks[(std::size_t(z) * by + y) * bx + x];
+					b.x = x;
+					b.y = y;
+					b.z = z;
+				}
+		count_of_bricks = bricks.size();
+	}
+
+	void build(const metaballs3d &f) {
+		auto &system = f.system();
+		for (auto &b : bricks)
+			b.balls.clear();
+
+		// bricks touched by the influence sphere of every ball
+		float size = brick_cells * step;
+		reach2.resize(system.size());
+		for (std::uint32_t id = 0; id < system.size(); ++id) {
+			vec3 p = system[id].position();
+			float r = f.influence(system[id]);
+			reach2[id] = r * r;
+			if (r <= 0)
+				continue;
+			vec3 lo = (p - origin - vec3(r, r, r)) * (1 / size), hi = (p - origin + vec3(r, r, r)) * (1 / size);
+			int x_1 = std::max(0, int(std::floor(lo.x))), x_2 = std::min(bx - 1, int(std::floor(hi.x))),
+				y_1 = std::max(0, int(std::floor(lo.y))), y_2 = std::min(by - 1, int(std::floor(hi.y))),
+				z_1 = std::max(0, int(std::floor(lo.z))), z_2 = std::min(bz - 1, int(std::floor(hi.z)));
+			for (int z = z_1; z <= z_2; ++z)
+				for (int y = y_1; y <= y_2; ++y)
+					for (int x = x_1; x <= x_2; ++x) {
+						// distance from the center to the brick box
+						vec3 a = origin + vec3(x, y, z) * size, d(0, 0, 0);
+						d.x = std::max(std::max(a.x - p.x, 0.f), p.x - a.x - size);
+						d.y = std::max(std::max(a.y - p.y, 0.f), p.y - a.y - size);
+						d.z = std::max(std::max(a.z - p.z, 0.f), p.z - a.z - size);
+						if (d.x * d.x + d.y * d.y + d.z * d.z <= r * r)
+							bricks[(std::size_t(z) * by + y) * bx + x].balls.push_back(id);
+					}
+		}
+
+		active.clear();
+		for (std::uint32_t i = 0; i < bricks.size(); ++i)
+			if (!bricks[i].balls.empty())
+				active.push_back(i);
+		active_bricks = active.size();
+
+		std::vector<std::array<std::uint8_t, 4>> colors(f.consts.size());
+		for (std::size_t level = 0; level < colors.size(); ++level)
+			palette::paint(colors[level].data(), f.consts[level], f.left_bound, f.right_bound);
+
+		parallel_for(active.size(), count_of_threads(active.size(), 4),
+			[&](std::size_t part, std::size_t from, std::size_t to) {
+				for (std::size_t i = from; i < to; ++i)
+					march(bricks[active[i]], f, colors);
+			});
+
+		// bricks share the vertices on their faces
+		vertices.clear();
+		triangles.clear();
+		seams.clear();
+		std::vector<std::uint32_t> renumber;
+		for (auto i : active) {
+			auto &b = bricks[i];
+			renumber.resize(b.vertices.size());
+			for (std::size_t v = 0; v < b.vertices.size(); ++v) {
+				if (b.vertices[v].seam) {
+					auto it = seams.find(b.vertices[v].key);
+					if (it != seams.end()) {
+						renumber[v] = it->second;
+						continue;
+					}
+					seams[b.vertices[v].key] = vertices.size();
+				}
+				renumber[v] = vertices.size();
+				vertices.push_back(b.vertices[v].v);
+			}
+			for (auto t : b.triangles)
+				triangles.push_back(renumber[t]);
+		}
+	}
+};